@@ -0,0 +1,437 @@
+﻿#ifndef __BASIC_FILE_GUARD_H__
+#define __BASIC_FILE_GUARD_H__
+
+#include <Windows.h>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+* 编译期组合的文件监控前端.
+* 过滤器(Filter)、编码(Encoding)与事件接收器(Sink)均为模板参数,
+* 在解码循环中直接内联,适用于规则在编译期即已确定的场景.
+*
+* Filter: bool operator()(uint32_t action, const std::string& file)
+* Sink: void operator()(uint32_t action, std::string& file) (可取走file的内容)
+* Encoding: static void append(const wchar_t* name, size_t length, std::string& out)
+* Error: void operator()(uint32_t error, const std::string& root)
+*   (缓冲区溢出时error为ERROR_NOTIFY_ENUM_DIR,监控继续,root之下的变化需重新扫描;其他错误后该路径停止监控)
+*/
+
+// 系统默认代码页编码
+struct AnsiEncoding
+{
+	static void append(const wchar_t* name, size_t length, std::string& out)
+	{
+		const int size = WideCharToMultiByte(CP_ACP, 0, name, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+		if (size <= 0) {
+			return;
+		}
+
+		const size_t offset = out.size();
+		out.resize(offset + size);
+		WideCharToMultiByte(CP_ACP, 0, name, static_cast<int>(length), &out[offset], size, nullptr, nullptr);
+	}
+};
+
+// UTF-8编码
+struct Utf8Encoding
+{
+	static void append(const wchar_t* name, size_t length, std::string& out)
+	{
+		const int size = WideCharToMultiByte(CP_UTF8, 0, name, static_cast<int>(length), nullptr, 0, nullptr, nullptr);
+		if (size <= 0) {
+			return;
+		}
+
+		const size_t offset = out.size();
+		out.resize(offset + size);
+		WideCharToMultiByte(CP_UTF8, 0, name, static_cast<int>(length), &out[offset], size, nullptr, nullptr);
+	}
+};
+
+// 接受所有事件
+struct AcceptAllFilter
+{
+	bool operator()(uint32_t, const std::string&) const
+	{
+		return true;
+	}
+};
+
+// 按后缀名过滤(运行时后缀列表,后缀须为小写且以'.'开头,列表为空时接受所有事件)
+struct SuffixFilter
+{
+	const std::vector<std::string>* suffixes = nullptr;
+
+	bool operator()(uint32_t, const std::string& file) const
+	{
+		if (!suffixes || suffixes->empty()) {
+			return true;
+		}
+
+		const size_t npos = file.find_last_of('.');
+		if (npos == std::string::npos) {
+			return false;
+		}
+
+		std::string suffix = file.substr(npos);
+		for (auto& x : suffix) {
+			if (x >= 'A' && x <= 'Z') {
+				x = static_cast<char>(x - 'A' + 'a');
+			}
+		}
+		return std::find(suffixes->begin(), suffixes->end(), suffix) != suffixes->end();
+	}
+};
+
+// 忽略错误
+struct IgnoreError
+{
+	void operator()(uint32_t, const std::string&) const
+	{
+	}
+};
+
+// 回调错误处理(运行时类型擦除)
+struct FunctionError
+{
+	std::function<void(uint32_t error, const char* path)> callback;
+
+	void operator()(uint32_t error, const std::string& root) const
+	{
+		if (callback) {
+			callback(error, root.c_str());
+		}
+	}
+};
+
+// 回调接收器(运行时类型擦除)
+struct FunctionSink
+{
+	std::function<void(uint32_t action, const char* file)> callback;
+
+	void operator()(uint32_t action, std::string& file) const
+	{
+		if (callback) {
+			callback(action, file.c_str());
+		}
+	}
+};
+
+/*
+* @brief 完成端口循环(BasicFileGuard与FileGuard的监控线程共用)
+* @param[in] port 完成端口
+* @param[in,out] handler 处理器,完成键为0的包为退出包,lpOverlapped为空的包为启动包:
+*   bool running() 是否继续取出完成包
+*   void dequeued() 取出一批完成包之后(同一批共用读取完成时间)
+*   void start(ULONG_PTR key) 启动包
+*   void* file(ULONG_PTR key) 完成键对应的目录句柄
+*   void complete(ULONG_PTR key, DWORD bytes, DWORD ecode) 读取完成,ecode为0代表成功,
+*     缓冲区溢出(返回0字节或ERROR_NOTIFY_ENUM_DIR)时ecode为ERROR_NOTIFY_ENUM_DIR且bytes为0,由处理器重新投递读取
+*   void quit(ULONG count) 本批中的退出包个数
+* @return 0代表正常退出,否则为GetQueuedCompletionStatusEx的错误码
+*/
+template<class Handler>
+inline DWORD pumpCompletions(HANDLE port, Handler& handler)
+{
+	//一次取出多个完成包,每批只进入内核一次
+	OVERLAPPED_ENTRY entries[64];
+	while (handler.running()) {
+		ULONG count = 0;
+		if (!GetQueuedCompletionStatusEx(port, entries, sizeof(entries) / sizeof(*entries), &count, INFINITE, FALSE)) {
+			return GetLastError();
+		}
+		handler.dequeued();
+
+		ULONG quits = 0;
+		for (ULONG i = 0; i < count; ++i) {
+			const ULONG_PTR key = entries[i].lpCompletionKey;
+			if (!key) {
+				++quits;
+				continue;
+			}
+
+			if (!entries[i].lpOverlapped) {
+				handler.start(key);
+				continue;
+			}
+
+			DWORD bytes = 0, ecode = 0;
+			if (!GetOverlappedResult(handler.file(key), entries[i].lpOverlapped, &bytes, FALSE)) {
+				ecode = GetLastError();
+				bytes = 0;
+			}
+			else if (!bytes) {
+				ecode = ERROR_NOTIFY_ENUM_DIR;
+			}
+			handler.complete(key, bytes, ecode);
+		}
+
+		if (quits) {
+			handler.quit(quits);
+		}
+	}
+	return 0;
+}
+
+template<class Filter, class Sink, class Encoding = AnsiEncoding, class Error = IgnoreError>
+class BasicFileGuard
+{
+public:
+	/*
+	* @brief 构造
+	* @param[in] filter 过滤器
+	* @param[in] sink 事件接收器
+	* @param[in] error 错误处理
+	*/
+	explicit BasicFileGuard(Filter filter = Filter(), Sink sink = Sink(), Error error = Error())
+		: m_filter(filter), m_sink(sink), m_error(error)
+	{
+		m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+	}
+
+	/*
+	* @brief 析构
+	*/
+	~BasicFileGuard()
+	{
+		stop();
+		for (auto& x : m_watches) {
+			CloseHandle(x->file);
+		}
+		m_watches.clear();
+
+		if (m_port) {
+			CloseHandle(m_port);
+			m_port = nullptr;
+		}
+	}
+
+	BasicFileGuard(const BasicFileGuard&) = delete;
+
+	BasicFileGuard& operator=(const BasicFileGuard&) = delete;
+
+	/*
+	* @brief 添加路径(须在启动前调用)
+	* @param[in] path 路径
+	* @param[in] subpath 是否监控子路径
+	* @retval true 成功
+	* @retval false 失败
+	*/
+	bool addPath(const std::string& path, bool subpath = true)
+	{
+		bool result = false;
+		do {
+			if (m_thread.joinable() || path.empty() || !m_port) {
+				break;
+			}
+
+			std::unique_ptr<Watch> watch(new Watch);
+			watch->root = path;
+			for (auto& x : watch->root) {
+				if (x == '/') {
+					x = '\\';
+				}
+			}
+
+			if (watch->root.back() != '\\') {
+				watch->root.append("\\");
+			}
+			watch->subpath = subpath;
+
+			watch->file = CreateFileA(watch->root.c_str(),
+				FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				nullptr,
+				OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+				nullptr);
+			if (watch->file == INVALID_HANDLE_VALUE) {
+				break;
+			}
+
+			if (CreateIoCompletionPort(watch->file, m_port, reinterpret_cast<ULONG_PTR>(watch.get()), 0) != m_port) {
+				CloseHandle(watch->file);
+				break;
+			}
+
+			m_watches.push_back(std::move(watch));
+			result = true;
+		} while (false);
+		return result;
+	}
+
+	/*
+	* @brief 启动(所有路径由同一个线程处理)
+	* @retval true 成功
+	* @retval false 失败
+	*/
+	bool start()
+	{
+		if (m_thread.joinable()) {
+			return true;
+		}
+
+		size_t pending = 0;
+		for (auto& x : m_watches) {
+			if (read(x.get())) {
+				++pending;
+			}
+		}
+
+		m_thread = std::thread([this, pending]() {
+			run(pending);
+		});
+		return pending == m_watches.size();
+	}
+
+	/*
+	* @brief 停止
+	* @return void
+	*/
+	void stop()
+	{
+		if (!m_thread.joinable()) {
+			return;
+		}
+
+		PostQueuedCompletionStatus(m_port, 0, 0, nullptr);
+		m_thread.join();
+	}
+
+	/*
+	* @brief 解码通知缓冲区(过滤、编码与接收均在此循环中内联)
+	* @param[in] root 监控路径(以'\\'结尾)
+	* @param[in] buffer ReadDirectoryChangesW返回的缓冲区
+	* @param[in] filter 过滤器
+	* @param[in] sink 事件接收器
+	* @param[in,out] file 复用的路径缓冲区
+	* @return 交给接收器的事件个数
+	*/
+	static size_t decode(const std::string& root, const void* buffer, Filter& filter, Sink& sink, std::string& file)
+	{
+		size_t count = 0;
+		const FILE_NOTIFY_INFORMATION* info = static_cast<const FILE_NOTIFY_INFORMATION*>(buffer);
+		while (true) {
+			file.assign(root);
+			Encoding::append(info->FileName, info->FileNameLength / sizeof(wchar_t), file);
+			if (filter(info->Action, file)) {
+				sink(info->Action, file);
+				++count;
+			}
+
+			if (!info->NextEntryOffset) {
+				break;
+			}
+			info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const uint8_t*>(info) + info->NextEntryOffset);
+		}
+		return count;
+	}
+
+private:
+	//监控记录(地址作为完成键)
+	struct Watch
+	{
+		OVERLAPPED lapped;
+		HANDLE file = INVALID_HANDLE_VALUE;
+		std::string root;
+		bool subpath = true;
+		DWORD buffer[64 * 1024 / sizeof(DWORD)];
+	};
+
+	//投递读取
+	static bool read(Watch* watch)
+	{
+		memset(&watch->lapped, 0, sizeof(watch->lapped));
+		return ReadDirectoryChangesW(watch->file,
+			watch->buffer,
+			sizeof(watch->buffer),
+			watch->subpath,
+			FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+			nullptr,
+			&watch->lapped,
+			nullptr) != FALSE;
+	}
+
+	//事件循环,收到退出包后取消所有读取,待全部完成后退出
+	void run(size_t pending)
+	{
+		struct Handler
+		{
+			BasicFileGuard* guard;
+			size_t pending;
+			bool stopped;
+			std::string path;
+
+			bool running() const
+			{
+				return pending || !stopped;
+			}
+
+			void dequeued()
+			{
+			}
+
+			void start(ULONG_PTR)
+			{
+			}
+
+			void* file(ULONG_PTR key) const
+			{
+				return reinterpret_cast<Watch*>(key)->file;
+			}
+
+			void complete(ULONG_PTR key, DWORD bytes, DWORD ecode)
+			{
+				Watch* watch = reinterpret_cast<Watch*>(key);
+				if (ecode && ecode != ERROR_NOTIFY_ENUM_DIR) {
+					if (ecode != ERROR_OPERATION_ABORTED) {
+						guard->m_error(ecode, watch->root);
+					}
+					--pending;
+					return;
+				}
+
+				//缓冲区溢出时缓冲区中仍是上次的内容,不解码但继续监控
+				if (bytes) {
+					decode(watch->root, watch->buffer, guard->m_filter, guard->m_sink, path);
+				}
+				else {
+					guard->m_error(ERROR_NOTIFY_ENUM_DIR, watch->root);
+				}
+
+				if (stopped) {
+					--pending;
+				}
+				else if (!read(watch)) {
+					guard->m_error(GetLastError(), watch->root);
+					--pending;
+				}
+			}
+
+			void quit(ULONG)
+			{
+				stopped = true;
+				for (auto& x : guard->m_watches) {
+					CancelIoEx(x->file, &x->lapped);
+				}
+			}
+		};
+
+		Handler handler = { this, pending, false, std::string() };
+		pumpCompletions(m_port, handler);
+	}
+
+	Filter m_filter;
+	Sink m_sink;
+	Error m_error;
+	HANDLE m_port = nullptr;
+	std::thread m_thread;
+	std::vector<std::unique_ptr<Watch>> m_watches;
+};
+
+#endif // !__BASIC_FILE_GUARD_H__
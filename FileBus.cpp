@@ -0,0 +1,793 @@
+﻿#include "FileBus.h"
+#include <Windows.h>
+
+//客户端槽位
+struct BusSlot
+{
+	volatile LONG pid;
+	volatile LONG waiting;
+	volatile LONG64 position;
+	char name[40];
+	uint64_t reserved;
+};
+
+static_assert(sizeof(BusSlot) == 64, "bus slot size");
+
+//总线头(位于共享内存起始处)
+//head与tail均为累计写入的字节数,对容量取模即为在环形缓冲区中的偏移
+struct BusHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	volatile LONG64 head;
+	volatile LONG64 tail;
+	volatile LONG64 sequence;
+	volatile LONG producer;
+	volatile LONG waiters;
+	uint64_t reserved[2];
+	BusSlot slots[FileBus::MAX_CLIENTS];
+};
+
+//事件记录(其后为路径,整条记录按8字节对齐且不跨越缓冲区末尾,action为0的记录为填充)
+struct BusRecord
+{
+	uint32_t size;
+	uint32_t action;
+	uint32_t length;
+	uint32_t kind;
+	uint64_t sequence;
+	uint64_t origin; //监控对象分配的事件序号
+	uint64_t timestamp;
+	uint64_t fileSize;
+	uint64_t mtime;
+	uint64_t id;
+	uint32_t attributes;
+	uint32_t volume;
+	uint32_t counts[5];
+	uint32_t reserved;
+};
+
+static_assert(sizeof(BusRecord) == 96, "bus record size");
+
+static const uint32_t BUS_MAGIC = 0x31424746; //FGB1
+
+static const uint32_t BUS_VERSION = 2;
+
+//数据区偏移
+static const size_t BUS_DATA = 4096;
+
+static_assert(sizeof(BusHeader) <= BUS_DATA, "bus header size");
+
+//共享内存名称
+static std::string busName(const std::string& name)
+{
+	return name.find('\\') == std::string::npos ? "Local\\" + name : name;
+}
+
+//客户端唤醒事件名称
+static std::string busEventName(const std::string& name, size_t slot)
+{
+	return busName(name) + "." + std::to_string(slot);
+}
+
+//映射视图的实际大小(已存在的共享内存不按请求的大小创建)
+static uint64_t viewSize(const void* view)
+{
+	MEMORY_BASIC_INFORMATION info = { 0 };
+	if (!VirtualQuery(view, &info, sizeof(info))) {
+		return 0;
+	}
+	return static_cast<uint64_t>(info.RegionSize);
+}
+
+//进程是否仍在运行
+static bool alive(DWORD pid)
+{
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	if (!process) {
+		//无权限打开时视为仍在运行
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+
+	const bool result = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return result;
+}
+
+FileBus::FileBus()
+{
+}
+
+FileBus::~FileBus()
+{
+	close();
+}
+
+bool FileBus::create(const std::string& name, size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool result = false;
+	do {
+		if (m_view) {
+			setLastError("总线已创建");
+			break;
+		}
+
+		if (name.empty()) {
+			setLastError("总线名称为空");
+			break;
+		}
+
+		//容量按页对齐,记录最大为容量的四分之一
+		capacity = ((std::max<size_t>)(capacity, 64 * 1024) + 4095) & ~static_cast<size_t>(4095);
+		const uint64_t total = BUS_DATA + static_cast<uint64_t>(capacity);
+		m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(total >> 32), static_cast<DWORD>(total), busName(name).c_str());
+		const bool exists = GetLastError() == ERROR_ALREADY_EXISTS;
+		if (!m_mapping) {
+			setLastError("创建%s总线失败,错误代码:%lu", name.c_str(), GetLastError());
+			break;
+		}
+
+		m_view = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0));
+		if (!m_view) {
+			setLastError("映射%s总线失败,错误代码:%lu", name.c_str(), GetLastError());
+			break;
+		}
+
+		//共享内存已存在时沿用其大小,容量不能超出实际映射的范围
+		const uint64_t size = viewSize(m_view);
+		if (size < BUS_DATA + 64 * 1024) {
+			setLastError("%s总线的共享内存过小,大小:%llu", name.c_str(), size);
+			break;
+		}
+
+		//客户端仍持有共享内存时,接管上一个服务端留下的缓冲区,客户端的读取位置保持有效
+		BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+		if (exists && header->magic == BUS_MAGIC && header->version == BUS_VERSION) {
+			if (header->producer && static_cast<DWORD>(header->producer) != GetCurrentProcessId() &&
+				alive(static_cast<DWORD>(header->producer))) {
+				setLastError("%s总线已有服务端,进程:%ld", name.c_str(), header->producer);
+				break;
+			}
+
+			if (!header->capacity || BUS_DATA + header->capacity > size) {
+				setLastError("%s总线的容量%llu超出共享内存大小%llu", name.c_str(), header->capacity, size);
+				break;
+			}
+		}
+		else {
+			memset(header, 0, sizeof(BusHeader));
+			header->magic = BUS_MAGIC;
+			header->version = BUS_VERSION;
+			header->capacity = (std::min<uint64_t>)(capacity, (size - BUS_DATA) & ~static_cast<uint64_t>(4095));
+		}
+
+		bool success = true;
+		for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+			m_events[i] = CreateEventA(nullptr, FALSE, FALSE, busEventName(name, i).c_str());
+			m_slow[i] = false;
+			if (!m_events[i]) {
+				setLastError("创建%s总线事件失败,错误代码:%lu", name.c_str(), GetLastError());
+				success = false;
+				break;
+			}
+		}
+
+		if (!success) {
+			break;
+		}
+
+		InterlockedExchange(&header->producer, static_cast<LONG>(GetCurrentProcessId()));
+		m_check = GetTickCount64();
+		result = true;
+	} while (false);
+
+	if (!result) {
+		for (auto& x : m_events) {
+			if (x) {
+				CloseHandle(x);
+				x = nullptr;
+			}
+		}
+
+		if (m_view) {
+			UnmapViewOfFile(m_view);
+			m_view = nullptr;
+		}
+
+		if (m_mapping) {
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+	}
+	return result;
+}
+
+void FileBus::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_view) {
+		BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+		InterlockedExchange(&header->producer, 0);
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+	}
+
+	for (auto& x : m_events) {
+		if (x) {
+			CloseHandle(x);
+			x = nullptr;
+		}
+	}
+
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+}
+
+bool FileBus::publish(const FileGuard::Event& event)
+{
+	const uint32_t length = event.file ? (event.length ? event.length : static_cast<uint32_t>(strlen(event.file))) : 0;
+	const uint32_t size = (sizeof(BusRecord) + length + 1 + 7) & ~7u;
+	bool check = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_view) {
+			return false;
+		}
+
+		BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+		const uint64_t capacity = header->capacity;
+		if (size > capacity / 4) {
+			setLastError("事件过大,长度:%u", length);
+			return false;
+		}
+
+		//记录不跨越缓冲区末尾,剩余空间不足时写入填充
+		const uint64_t offset = static_cast<uint64_t>(header->head) % capacity;
+		if (offset + size > capacity) {
+			BusRecord padding = {};
+			padding.size = static_cast<uint32_t>(capacity - offset);
+			write(&padding, nullptr, 0, padding.size);
+		}
+
+		BusRecord record = {};
+		record.size = size;
+		record.action = event.action;
+		record.length = length;
+		record.kind = event.kind;
+		record.sequence = static_cast<uint64_t>(header->sequence);
+		record.origin = event.sequence;
+		record.timestamp = event.timestamp;
+		record.fileSize = event.size;
+		record.mtime = event.mtime;
+		record.id = event.id;
+		record.attributes = event.attributes;
+		record.volume = event.volume;
+		memcpy(record.counts, event.counts, sizeof(record.counts));
+		write(&record, event.file, length, size);
+		InterlockedExchange64(&header->sequence, header->sequence + 1);
+		wake();
+
+		check = GetTickCount64() - m_check >= 100;
+	}
+
+	if (check) {
+		this->check();
+	}
+	return true;
+}
+
+void FileBus::check()
+{
+	struct Report
+	{
+		std::string client;
+		uint32_t pid;
+		uint64_t lag;
+		bool lost;
+	};
+
+	std::vector<Report> reports;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_view) {
+			return;
+		}
+
+		m_check = GetTickCount64();
+		BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+		const uint64_t head = static_cast<uint64_t>(header->head);
+		const uint64_t tail = static_cast<uint64_t>(header->tail);
+		for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+			BusSlot& slot = header->slots[i];
+			const LONG pid = slot.pid;
+			if (!pid) {
+				m_slow[i] = false;
+				continue;
+			}
+
+			//回收未断开就退出的客户端
+			if (!alive(static_cast<DWORD>(pid))) {
+				InterlockedCompareExchange(&slot.pid, 0, pid);
+				m_slow[i] = false;
+				continue;
+			}
+
+			//落后超过一半容量时报告一次,追上到四分之一以内后重新计算
+			const uint64_t position = static_cast<uint64_t>(slot.position);
+			const uint64_t lag = head > position ? head - position : 0;
+			const bool lost = position < tail;
+			if (lost || lag > header->capacity / 2) {
+				if (!m_slow[i]) {
+					m_slow[i] = true;
+					reports.push_back({ std::string(slot.name, strnlen(slot.name, sizeof(slot.name))),
+						static_cast<uint32_t>(pid), lag, lost });
+				}
+			}
+			else if (lag < header->capacity / 4) {
+				m_slow[i] = false;
+			}
+		}
+	}
+
+	if (onSlowClient) {
+		for (const auto& x : reports) {
+			onSlowClient(x.client.c_str(), x.pid, x.lag, x.lost);
+		}
+	}
+}
+
+size_t FileBus::getClients() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t result = 0;
+	if (m_view) {
+		const BusHeader* header = reinterpret_cast<const BusHeader*>(m_view);
+		for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+			if (header->slots[i].pid) {
+				++result;
+			}
+		}
+	}
+	return result;
+}
+
+const char* FileBus::getLastError() const
+{
+	return m_error.c_str();
+}
+
+void FileBus::setLastError(const char* fmt, ...)
+{
+	char buff[512] = { 0 };
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(buff, sizeof(buff), fmt, ap);
+	va_end(ap);
+	m_error = buff;
+}
+
+void FileBus::write(const void* record, const char* file, uint32_t length, uint32_t size)
+{
+	BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+	char* data = m_view + BUS_DATA;
+	const uint64_t capacity = header->capacity;
+	const uint64_t head = static_cast<uint64_t>(header->head);
+	uint64_t tail = static_cast<uint64_t>(header->tail);
+
+	//先推进尾部再覆盖,客户端读完记录后据此判断是否读到了被覆盖的内容
+	while (head + size - tail > capacity) {
+		tail += reinterpret_cast<const BusRecord*>(data + tail % capacity)->size;
+	}
+	InterlockedExchange64(&header->tail, static_cast<LONG64>(tail));
+
+	char* target = data + head % capacity;
+	memcpy(target, record, (std::min<size_t>)(size, sizeof(BusRecord)));
+	if (file) {
+		memcpy(target + sizeof(BusRecord), file, length);
+		target[sizeof(BusRecord) + length] = 0;
+	}
+	InterlockedExchange64(&header->head, static_cast<LONG64>(head + size));
+}
+
+void FileBus::wake()
+{
+	BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+	if (!header->waiters) {
+		return;
+	}
+
+	for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+		if (header->slots[i].pid && header->slots[i].waiting) {
+			SetEvent(m_events[i]);
+		}
+	}
+}
+
+FileBus::Client::Client()
+{
+}
+
+FileBus::Client::~Client()
+{
+	disconnect();
+}
+
+bool FileBus::Client::connect(const std::string& name, const std::string& client, bool oldest)
+{
+	disconnect();
+	bool result = false;
+	do {
+		m_mapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, busName(name).c_str());
+		if (!m_mapping) {
+			m_error = name + "总线不存在";
+			break;
+		}
+
+		m_view = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0));
+		if (!m_view) {
+			m_error = "映射" + name + "总线失败";
+			break;
+		}
+
+		BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+		if (header->magic != BUS_MAGIC || header->version != BUS_VERSION) {
+			m_error = name + "总线版本不匹配";
+			break;
+		}
+
+		//容量以服务端写入的为准,但不能超出本进程实际映射的范围
+		m_size = viewSize(m_view);
+		if (!header->capacity || BUS_DATA + header->capacity > m_size) {
+			m_error = name + "总线的容量超出共享内存大小";
+			break;
+		}
+
+		const LONG pid = static_cast<LONG>(GetCurrentProcessId());
+		for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+			if (InterlockedCompareExchange(&header->slots[i].pid, pid, 0) == 0) {
+				m_slot = i;
+				break;
+			}
+		}
+
+		if (m_slot == MAX_CLIENTS) {
+			m_error = name + "总线的客户端已满";
+			break;
+		}
+
+		BusSlot& slot = header->slots[m_slot];
+		strncpy_s(slot.name, client.c_str(), _TRUNCATE);
+		slot.waiting = 0;
+		m_event = OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, busEventName(name, m_slot).c_str());
+		if (!m_event) {
+			m_error = "打开" + name + "总线事件失败";
+			break;
+		}
+
+		m_position = static_cast<uint64_t>(oldest ? header->tail : header->head);
+		m_sequence = oldest ? 0 : static_cast<uint64_t>(header->sequence);
+		m_lost = 0;
+		InterlockedExchange64(&slot.position, static_cast<LONG64>(m_position));
+		result = true;
+	} while (false);
+
+	if (!result) {
+		disconnect();
+	}
+	return result;
+}
+
+void FileBus::Client::disconnect()
+{
+	if (m_view && m_slot < MAX_CLIENTS) {
+		BusSlot& slot = reinterpret_cast<BusHeader*>(m_view)->slots[m_slot];
+		slot.waiting = 0;
+		InterlockedExchange(&slot.pid, 0);
+	}
+	m_slot = MAX_CLIENTS;
+
+	if (m_event) {
+		CloseHandle(m_event);
+		m_event = nullptr;
+	}
+
+	if (m_view) {
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+		m_size = 0;
+	}
+
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+}
+
+size_t FileBus::Client::read(FileGuard::Event* events, size_t count, char* buffer, size_t size, uint32_t timeout)
+{
+	size_t result = 0, used = 0;
+	if (!m_view || m_slot == MAX_CLIENTS || !events || !count || !buffer || !size) {
+		return result;
+	}
+
+	BusHeader* header = reinterpret_cast<BusHeader*>(m_view);
+	BusSlot& slot = header->slots[m_slot];
+	const char* data = m_view + BUS_DATA;
+	const uint64_t capacity = header->capacity;
+	if (!capacity || BUS_DATA + capacity > m_size) {
+		m_error = "总线的容量超出共享内存大小";
+		return result;
+	}
+
+	const uint64_t deadline = GetTickCount64() + timeout;
+	while (true) {
+		const uint64_t head = static_cast<uint64_t>(InterlockedCompareExchange64(&header->head, 0, 0));
+		bool full = false;
+		while (result < count && m_position < head) {
+			//已被覆盖时跳到最旧的记录,丢失的个数由序号的间隔得出
+			const uint64_t tail = static_cast<uint64_t>(InterlockedCompareExchange64(&header->tail, 0, 0));
+			if (m_position < tail) {
+				m_position = tail;
+				continue;
+			}
+
+			const uint64_t offset = m_position % capacity;
+			BusRecord record = {};
+			memcpy(&record, data + offset, (std::min<uint64_t>)(sizeof(BusRecord), capacity - offset));
+			const bool valid = record.size >= 8 && (record.size & 7) == 0 && offset + record.size <= capacity &&
+				(!record.action || sizeof(BusRecord) + record.length < record.size);
+			if (valid && record.action && used + record.length + 1 > size) {
+				full = true;
+				break;
+			}
+
+			if (valid && record.action) {
+				memcpy(buffer + used, data + offset + sizeof(BusRecord), record.length);
+				buffer[used + record.length] = 0;
+			}
+
+			//读取期间被覆盖的记录丢弃
+			if (static_cast<uint64_t>(InterlockedCompareExchange64(&header->tail, 0, 0)) > m_position) {
+				continue;
+			}
+
+			if (!valid) {
+				m_position = head;
+				break;
+			}
+
+			m_position += record.size;
+			if (!record.action) {
+				continue;
+			}
+
+			if (m_sequence && record.sequence > m_sequence) {
+				m_lost += record.sequence - m_sequence;
+			}
+			m_sequence = record.sequence + 1;
+
+			if (!accept(record.action, buffer + used, record.length)) {
+				continue;
+			}
+
+			FileGuard::Event& event = events[result++];
+			event = FileGuard::Event();
+			event.action = record.action;
+			event.file = buffer + used;
+			event.length = record.length;
+			event.timestamp = record.timestamp;
+			event.sequence = record.origin;
+			event.kind = record.kind;
+			event.attributes = record.attributes;
+			event.size = record.fileSize;
+			event.mtime = record.mtime;
+			event.id = record.id;
+			event.volume = record.volume;
+			memcpy(event.counts, record.counts, sizeof(event.counts));
+			used += record.length + 1;
+		}
+		InterlockedExchange64(&slot.position, static_cast<LONG64>(m_position));
+
+		const uint64_t now = GetTickCount64();
+		if (result || full || now >= deadline) {
+			break;
+		}
+
+		//登记等待后再检查一次,服务端发布后必然能看到等待标志或客户端能看到新位置
+		InterlockedExchange(&slot.waiting, 1);
+		InterlockedIncrement(&header->waiters);
+		if (static_cast<uint64_t>(InterlockedCompareExchange64(&header->head, 0, 0)) == m_position) {
+			WaitForSingleObject(m_event, static_cast<DWORD>(deadline - now));
+		}
+		InterlockedExchange(&slot.waiting, 0);
+		InterlockedDecrement(&header->waiters);
+	}
+	return result;
+}
+
+void FileBus::Client::setActions(uint32_t actions)
+{
+	m_actions = actions;
+}
+
+void FileBus::Client::addSuffix(const std::string& suffix)
+{
+	std::string data = suffix;
+	if (data.empty()) {
+		return;
+	}
+
+	if (data[0] != '.') {
+		data.insert(data.begin(), '.');
+	}
+	m_suffixes.push_back(data);
+}
+
+void FileBus::Client::addPath(const std::string& path)
+{
+	std::string data = path;
+	for (auto& x : data) {
+		if (x == '/') {
+			x = '\\';
+		}
+	}
+
+	if (!data.empty() && data.back() != '\\') {
+		data.append("\\");
+	}
+	m_paths.push_back(data);
+}
+
+uint64_t FileBus::Client::getLost() const
+{
+	return m_lost;
+}
+
+const char* FileBus::Client::getLastError() const
+{
+	return m_error.c_str();
+}
+
+bool FileBus::Client::accept(uint32_t action, const char* file, uint32_t length) const
+{
+	if (action >= 32 || !(m_actions >> action & 1)) {
+		return false;
+	}
+
+	if (!m_paths.empty() && std::none_of(m_paths.begin(), m_paths.end(), [file, length](const std::string& x) {
+		return x.length() <= length && _strnicmp(file, x.c_str(), x.length()) == 0;
+	})) {
+		return false;
+	}
+
+	if (!m_suffixes.empty()) {
+		const char* dot = strrchr(file, '.');
+		if (!dot || std::none_of(m_suffixes.begin(), m_suffixes.end(), [dot](const std::string& x) {
+			return _stricmp(dot, x.c_str()) == 0;
+		})) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#if defined(FILE_GUARD_C_API)
+
+#define get_bus(x) ((FileBus*)(x))
+
+#define get_client(x) ((FileBus::Client*)(x))
+
+void* file_bus_new()
+{
+	return new FileBus;
+}
+
+void file_bus_free(void* bus)
+{
+	if (bus) {
+		delete static_cast<FileBus*>(bus);
+	}
+}
+
+bool file_bus_create(void* bus, const char* name, uint64_t capacity)
+{
+	return get_bus(bus)->create(name, capacity ? static_cast<size_t>(capacity) : 16 * 1024 * 1024);
+}
+
+void file_bus_close(void* bus)
+{
+	get_bus(bus)->close();
+}
+
+bool file_bus_publish(void* bus, uint32_t action, const char* file)
+{
+	FileGuard::Event event = FileGuard::Event();
+	event.action = action;
+	event.file = file;
+	event.length = file ? static_cast<uint32_t>(strlen(file)) : 0;
+	return get_bus(bus)->publish(event);
+}
+
+void file_bus_set_on_slow_client_callback(void* bus,
+	void(*callback)(const char* client, uint32_t pid, uint64_t lag, bool lost, void* user), void* user)
+{
+	get_bus(bus)->onSlowClient = [user, callback](const char* client, uint32_t pid, uint64_t lag, bool lost) {
+		callback(client, pid, lag, lost, user);
+	};
+}
+
+void* file_bus_client_new()
+{
+	return new FileBus::Client;
+}
+
+void file_bus_client_free(void* client)
+{
+	if (client) {
+		delete static_cast<FileBus::Client*>(client);
+	}
+}
+
+bool file_bus_client_connect(void* client, const char* name, const char* client_name, bool oldest)
+{
+	return get_client(client)->connect(name, client_name ? client_name : "", oldest);
+}
+
+void file_bus_client_disconnect(void* client)
+{
+	get_client(client)->disconnect();
+}
+
+void file_bus_client_set_actions(void* client, uint32_t actions)
+{
+	get_client(client)->setActions(actions);
+}
+
+void file_bus_client_add_suffix(void* client, const char* suffix)
+{
+	get_client(client)->addSuffix(suffix);
+}
+
+void file_bus_client_add_path(void* client, const char* path)
+{
+	get_client(client)->addPath(path);
+}
+
+int file_bus_client_read(void* client, file_guard_event* events, int max, char* buffer, int size, int timeout_ms)
+{
+	if (!events || max <= 0 || !buffer || size <= 0) {
+		return 0;
+	}
+
+	std::vector<FileGuard::Event> temp(max);
+	const size_t count = get_client(client)->read(temp.data(), temp.size(), buffer, size, timeout_ms > 0 ? timeout_ms : 0);
+	for (size_t i = 0; i < count; ++i) {
+		const FileGuard::Event& x = temp[i];
+		events[i].action = x.action;
+		events[i].offset = static_cast<uint32_t>(x.file - buffer);
+		events[i].length = x.length;
+		events[i].timestamp = x.timestamp;
+		events[i].sequence = x.sequence;
+		events[i].kind = x.kind;
+		events[i].attributes = x.attributes;
+		events[i].size = x.size;
+		events[i].mtime = x.mtime;
+		events[i].id = x.id;
+		events[i].volume = x.volume;
+		memcpy(events[i].counts, x.counts, sizeof(events[i].counts));
+		events[i].directory = 0;
+	}
+	return static_cast<int>(count);
+}
+
+uint64_t file_bus_client_get_lost(void* client)
+{
+	return get_client(client)->getLost();
+}
+
+#endif // !FILE_GUARD_C_API
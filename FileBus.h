@@ -0,0 +1,225 @@
+﻿#ifndef __FILE_BUS_H__
+#define __FILE_BUS_H__
+
+#include "FileGuard.h"
+
+/*
+* 同一主机上的多进程事件总线.
+* 由一个进程(服务端)持有监控并将解码后的事件发布到命名共享内存中的环形缓冲区,
+* 其他进程(客户端)以各自的过滤条件与读取位置订阅,监控与解码的开销每台主机只承担一次.
+* 服务端从不等待客户端,读取过慢的客户端会被覆盖并丢失事件,服务端通过回调报告.
+*/
+class FileBus
+{
+public:
+	//最多同时连接的客户端个数
+	static const size_t MAX_CLIENTS = 32;
+
+	// 客户端
+	class Client
+	{
+	public:
+		Client();
+
+		~Client();
+
+		Client(const Client&) = delete;
+
+		Client& operator=(const Client&) = delete;
+
+		/*
+		* @brief 连接
+		* @param[in] name 总线名称(与服务端相同)
+		* @param[in] client 客户端名称(用于服务端报告)
+		* @param[in] oldest 是否从缓冲区中最旧的事件开始读取(否则从最新位置开始)
+		* @retval true 成功
+		* @retval false 失败
+		*/
+		bool connect(const std::string& name, const std::string& client, bool oldest = false);
+
+		/*
+		* @brief 断开
+		* @return void
+		*/
+		void disconnect();
+
+		/*
+		* @brief 读取事件
+		* @param[out] events 事件数组
+		* @param[in] count 事件数组大小
+		* @param[out] buffer 路径缓冲区,事件中的文件指向此缓冲区
+		* @param[in] size 路径缓冲区大小
+		* @param[in] timeout 没有新事件时的等待时间(毫秒)
+		* @return 读取的事件个数
+		*/
+		size_t read(FileGuard::Event* events, size_t count, char* buffer, size_t size, uint32_t timeout = 0);
+
+		/*
+		* @brief 设置动作掩码
+		* @param[in] actions 动作掩码(1 << FileGuard::Action的组合)
+		* @return void
+		*/
+		void setActions(uint32_t actions);
+
+		/*
+		* @brief 添加后缀(未添加时接受所有后缀)
+		* @param[in] suffix 后缀名
+		* @return void
+		*/
+		void addSuffix(const std::string& suffix);
+
+		/*
+		* @brief 添加路径(未添加时接受所有路径)
+		* @param[in] path 只接受位于此路径之下的事件
+		* @return void
+		*/
+		void addPath(const std::string& path);
+
+		/*
+		* @brief 获取丢失的事件个数
+		* @return 因读取过慢被覆盖的事件个数
+		*/
+		uint64_t getLost() const;
+
+		/*
+		* @brief 获取最终错误
+		* @return 最终错误
+		*/
+		const char* getLastError() const;
+	private:
+		//是否接受
+		bool accept(uint32_t action, const char* file, uint32_t length) const;
+
+		void* m_mapping = nullptr;
+		char* m_view = nullptr;
+		uint64_t m_size = 0;
+		void* m_event = nullptr;
+		size_t m_slot = MAX_CLIENTS;
+		uint64_t m_position = 0;
+		uint64_t m_sequence = 0;
+		uint64_t m_lost = 0;
+		uint32_t m_actions = FileGuard::ALL_ACTIONS;
+		std::vector<std::string> m_suffixes;
+		std::vector<std::string> m_paths;
+		std::string m_error;
+	};
+
+	FileBus();
+
+	~FileBus();
+
+	FileBus(const FileBus&) = delete;
+
+	FileBus& operator=(const FileBus&) = delete;
+
+	/*
+	* @brief 创建(服务端)
+	* @param[in] name 总线名称(不含'\\'时位于Local\\命名空间)
+	* @param[in] capacity 环形缓冲区大小(字节)
+	* @retval true 成功
+	* @retval false 失败(如已有其他服务端)
+	*/
+	bool create(const std::string& name, size_t capacity = 16 * 1024 * 1024);
+
+	/*
+	* @brief 关闭
+	* @return void
+	*/
+	void close();
+
+	/*
+	* @brief 发布事件(可在监控回调中直接调用,从不等待客户端)
+	* @param[in] event 事件
+	* @retval true 成功
+	* @retval false 未创建或事件过大
+	*/
+	bool publish(const FileGuard::Event& event);
+
+	/*
+	* @brief 检查客户端(回收已退出的客户端并报告读取过慢的客户端,发布时每100毫秒自动检查一次)
+	* @return void
+	*/
+	void check();
+
+	/*
+	* @brief 获取已连接的客户端个数
+	* @return 客户端个数
+	*/
+	size_t getClients() const;
+
+	/*
+	* @brief 获取最终错误
+	* @return 最终错误
+	*/
+	const char* getLastError() const;
+
+	//慢客户端回调(lag为落后的字节数,已被覆盖时lost为true)
+	std::function<void(const char* client, uint32_t pid, uint64_t lag, bool lost)> onSlowClient = nullptr;
+protected:
+	/*
+	* @brief 设置最终错误
+	* @param[in] fmt 格式化字符串
+	* @param[in] ... 可变参数
+	* @return void
+	*/
+	void setLastError(const char* fmt, ...);
+
+private:
+	//写入一条记录(须持有m_mutex)
+	void write(const void* header, const char* file, uint32_t length, uint32_t size);
+
+	//唤醒等待中的客户端
+	void wake();
+
+	mutable std::mutex m_mutex;
+	void* m_mapping = nullptr;
+	char* m_view = nullptr;
+	void* m_events[MAX_CLIENTS] = {};
+	bool m_slow[MAX_CLIENTS] = {};
+	uint64_t m_check = 0;
+	std::string m_error;
+};
+
+#if defined(FILE_GUARD_C_API)
+
+#if defined(__cplusplus)
+extern "C" {
+#endif // !__cplusplus
+
+	FILE_GUARD_DLL_EXPORT void* file_bus_new();
+
+	FILE_GUARD_DLL_EXPORT void file_bus_free(void* bus);
+
+	FILE_GUARD_DLL_EXPORT bool file_bus_create(void* bus, const char* name, uint64_t capacity);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_close(void* bus);
+
+	FILE_GUARD_DLL_EXPORT bool file_bus_publish(void* bus, uint32_t action, const char* file);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_set_on_slow_client_callback(void* bus,
+		void (*callback)(const char* client, uint32_t pid, uint64_t lag, bool lost, void* user), void* user);
+
+	FILE_GUARD_DLL_EXPORT void* file_bus_client_new();
+
+	FILE_GUARD_DLL_EXPORT void file_bus_client_free(void* client);
+
+	FILE_GUARD_DLL_EXPORT bool file_bus_client_connect(void* client, const char* name, const char* client_name, bool oldest);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_client_disconnect(void* client);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_client_set_actions(void* client, uint32_t actions);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_client_add_suffix(void* client, const char* suffix);
+
+	FILE_GUARD_DLL_EXPORT void file_bus_client_add_path(void* client, const char* path);
+
+	FILE_GUARD_DLL_EXPORT int file_bus_client_read(void* client, struct file_guard_event* events, int max,
+		char* buffer, int size, int timeout_ms);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_bus_client_get_lost(void* client);
+
+#if defined(__cplusplus)
+}
+#endif // !__cplusplus
+#endif // !FILE_GUARD_C_API
+#endif // !__FILE_BUS_H__
@@ -1,6 +1,8 @@
 ﻿#include "FileGuard.h"
+#include "BasicFileGuard.h"
 #include <Windows.h>
 #include <io.h>
+#include <atomic>
 
 #if defined(_DEBUG)
 #define print(fmt, ...)\
@@ -14,47 +16,324 @@ do { \
 #define print(fmt, ...)
 #endif
 
-static std::string unicode2ansi(const std::wstring& str)
+//规范化路径(统一分隔符并转为小写,用作索引键)
+static std::string normalize(const std::string& path, bool dir = true)
 {
-	int size = WideCharToMultiByte(CP_ACP, 0, str.c_str(), -1, 0, 0, 0, 0);
-	std::unique_ptr<char> buffer(new char[size]);
-	memset(buffer.get(), 0, size);
-	WideCharToMultiByte(CP_ACP, 0, str.c_str(), -1, buffer.get(), size, 0, 0);
-	return std::string(buffer.get());
+	std::string key(path);
+	for (size_t i = 0; i < key.length(); ++i) {
+		const unsigned char c = static_cast<unsigned char>(key[i]);
+		if (IsDBCSLeadByte(c)) {
+			++i;
+		}
+		else if (c == '/') {
+			key[i] = '\\';
+		}
+		else if (c >= 'A' && c <= 'Z') {
+			key[i] = static_cast<char>(c - 'A' + 'a');
+		}
+	}
+
+	if (dir && !key.empty() && key.back() != '\\') {
+		key.append("\\");
+	}
+	return key;
+}
+
+//拆分规范化路径的各级名称
+static void split(const std::string& key, std::vector<std::string>& parts)
+{
+	parts.clear();
+	size_t begin = 0;
+	for (size_t i = 0; i < key.length(); ++i) {
+		if (IsDBCSLeadByte(static_cast<unsigned char>(key[i]))) {
+			++i;
+		}
+		else if (key[i] == '\\') {
+			if (i > begin) {
+				parts.push_back(key.substr(begin, i - begin));
+			}
+			begin = i + 1;
+		}
+	}
+
+	if (begin < key.length()) {
+		parts.push_back(key.substr(begin));
+	}
+}
+
+//单调时钟(微秒)
+static uint64_t monotonic()
+{
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER li = { 0 };
+		QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	LARGE_INTEGER li = { 0 };
+	QueryPerformanceCounter(&li);
+	return static_cast<uint64_t>(li.QuadPart / frequency * 1000000 + li.QuadPart % frequency * 1000000 / frequency);
+}
+
+//跟踪类型
+enum TraceType
+{
+	TRACE_READ_ISSUED,
+	TRACE_READ_COMPLETED,
+	TRACE_DECODE,
+	TRACE_CALLBACK,
+	TRACE_COMPARE,
+	TRACE_CANCEL,
+};
+
+static const char* const TRACE_NAMES[] = {
+	"read issued",
+	"read completed",
+	"decode",
+	"callback",
+	"compare",
+	"cancel",
+};
+
+//跟踪记录(固定大小)
+struct TraceRecord
+{
+	uint64_t timestamp;
+	uint64_t duration;
+	uint64_t value;
+	uint32_t type;
+	uint32_t reserved;
+};
+
+//跟踪环形缓冲区(每个线程一个,仅所属线程写入)
+struct TraceRing
+{
+	static const size_t SIZE = 4096;
+	std::atomic<uint64_t> head{ 0 };
+	std::atomic<bool> exited{ false };
+	uint32_t thread = 0;
+	TraceRecord records[SIZE];
+};
+
+//线程退出时标记其环形缓冲区
+struct TraceOwner
+{
+	std::shared_ptr<TraceRing> ring;
+
+	~TraceOwner()
+	{
+		if (ring) {
+			ring->exited.store(true, std::memory_order_release);
+		}
+	}
+};
+
+//已退出的线程最多保留的环形缓冲区个数
+static const size_t TRACE_EXITED_LIMIT = 16;
+
+static std::atomic<bool> g_trace(false);
+
+static std::mutex g_traceMutex;
+
+static std::vector<std::shared_ptr<TraceRing>> g_traceRings;
+
+static void traceWrite(uint32_t type, uint64_t begin, uint64_t value)
+{
+	thread_local TraceOwner owner;
+	std::shared_ptr<TraceRing>& ring = owner.ring;
+	if (!ring) {
+		ring = std::make_shared<TraceRing>();
+		ring->thread = GetCurrentThreadId();
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+
+		//投递线程、轮询线程等随启动停止反复重建,已退出的线程只保留最近的若干个以便导出
+		size_t exited = std::count_if(g_traceRings.begin(), g_traceRings.end(),
+			[](const std::shared_ptr<TraceRing>& x) { return x->exited.load(std::memory_order_acquire); });
+		for (auto iter = g_traceRings.begin(); iter != g_traceRings.end() && exited > TRACE_EXITED_LIMIT;) {
+			if ((*iter)->exited.load(std::memory_order_acquire)) {
+				iter = g_traceRings.erase(iter);
+				--exited;
+			}
+			else {
+				++iter;
+			}
+		}
+		g_traceRings.push_back(ring);
+	}
+
+	const uint64_t now = monotonic();
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	TraceRecord& record = ring->records[head % TraceRing::SIZE];
+	record.timestamp = begin ? begin : now;
+	record.duration = begin ? now - begin : 0;
+	record.value = value;
+	record.type = type;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+//跟踪起始时间,未启用时为0
+static uint64_t traceTick()
+{
+	return g_trace.load(std::memory_order_relaxed) ? monotonic() : 0;
 }
 
+//写入跟踪记录(未启用时只有一次分支判断),begin为0代表瞬时记录
+#define trace(type, begin, value)\
+do { \
+	if (g_trace.load(std::memory_order_relaxed)) {\
+		traceWrite(type, begin, value);\
+	}\
+} while (0)
+
+//64位内容哈希(xxHash64算法,支持分块输入)
+class Hasher
+{
+public:
+	Hasher()
+	{
+		m_v[0] = PRIME1 + PRIME2;
+		m_v[1] = PRIME2;
+		m_v[2] = 0;
+		m_v[3] = 0 - PRIME1;
+	}
+
+	//输入数据(除最后一块外,长度必须为32的倍数)
+	void update(const uint8_t* data, size_t size)
+	{
+		const uint8_t* end = data + size;
+		for (; data + 32 <= end; data += 32) {
+			for (int i = 0; i < 4; ++i) {
+				m_v[i] = round(m_v[i], read64(data + i * 8));
+			}
+		}
+		m_total += size;
+		m_tail = data;
+		m_end = end;
+	}
+
+	//计算结果
+	uint64_t finish() const
+	{
+		uint64_t h = PRIME5;
+		if (m_total >= 32) {
+			h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+			for (int i = 0; i < 4; ++i) {
+				h = (h ^ round(0, m_v[i])) * PRIME1 + PRIME4;
+			}
+		}
+		h += m_total;
+
+		const uint8_t* p = m_tail;
+		for (; p && p + 8 <= m_end; p += 8) {
+			h = rotl(h ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+		}
+		for (; p && p + 4 <= m_end; p += 4) {
+			uint32_t v = 0;
+			memcpy(&v, p, sizeof(v));
+			h = rotl(h ^ (v * PRIME1), 23) * PRIME2 + PRIME3;
+		}
+		for (; p && p < m_end; ++p) {
+			h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+		}
+
+		h ^= h >> 33;
+		h *= PRIME2;
+		h ^= h >> 29;
+		h *= PRIME3;
+		h ^= h >> 32;
+		return h;
+	}
+
+private:
+	static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+	static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+	static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	static uint64_t rotl(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static uint64_t read64(const uint8_t* p)
+	{
+		uint64_t v = 0;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static uint64_t round(uint64_t acc, uint64_t input)
+	{
+		return rotl(acc + input * PRIME2, 31) * PRIME1;
+	}
+
+	uint64_t m_v[4];
+	uint64_t m_total = 0;
+	const uint8_t* m_tail = nullptr;
+	const uint8_t* m_end = nullptr;
+};
+
 const char* const FileGuard::ALL_DISK_PATHS = "*";
 
 const char* const FileGuard::EXCEPT_SYSTEM_DISK_PATHS = "&";
 
 const char* const FileGuard::ALL_SUFFIXES = ".*";
 
+const uint32_t FileGuard::ALL_ACTIONS;
+
+const uint32_t FileGuard::SUMMARY_INTERVAL;
+
+const uint32_t FileGuard::STOP_TIMEOUT;
+
+const uint32_t FileGuard::AGGREGATE_WINDOW;
+
+const uint32_t FileGuard::MIN_INTERVAL;
+
+const uint32_t FileGuard::MAX_INTERVAL;
+
 FileGuard::FileGuard()
 {
-
+	m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+	resetStatistics();
 }
 
 FileGuard::~FileGuard()
 {
 	stop();
 	clearPaths();
+	setContentFilter(false);
+	setPollMode(false);
+
+	for (size_t i = 0; i < m_loops.size(); ++i) {
+		PostQueuedCompletionStatus(m_port, 0, 0, nullptr);
+	}
+
+	for (auto& x : m_loops) {
+		if (x.joinable()) {
+			x.join();
+		}
+	}
+	m_loops.clear();
+
+	if (m_port) {
+		CloseHandle(m_port);
+		m_port = nullptr;
+	}
 }
 
 bool FileGuard::existPath(const std::string& path) const
 {
-	bool exist = false;
-	for (const auto& x : m_args)
-	{
-		if (x.path == path)
-		{
-			exist = true;
-			break;
-		}
-	}
-	return exist;
+	return m_index.find(normalize(path)) != m_index.end();
 }
 
 bool FileGuard::addPath(const std::string& path, bool subpath)
+{
+	Option option;
+	option.subpath = subpath;
+	return addPath(path, option);
+}
+
+bool FileGuard::addPath(const std::string& path, const Option& option)
 {
 	bool result = false, success = true;
 	do
@@ -125,16 +404,26 @@ bool FileGuard::addPath(const std::string& path, bool subpath)
 
 		for (const auto& x : paths) {
 			if (!existPath(x)) {
-				Arg arg;
-				if (!arg.create(x, subpath)) {
+				std::unique_ptr<Arg> arg(new Arg);
+				std::string error;
+				if (!arg->create(x, option, m_port, error)) {
 					success = false;
-					setLastError(arg.error);
+					setLastError("%s", error.c_str());
 					if (path == ALL_DISK_PATHS || path == EXCEPT_SYSTEM_DISK_PATHS) {
 						continue;
 					}
 					break;
 				}
-				m_args.push_back(arg);
+
+				//被排除的子树不进入内核监控,其祖先目录拆分为只监控自身
+				//轮询方式在扫描时直接跳过被排除的子树
+				if (option.subpath && option.prune && !m_excludes.empty() && arg->option.backend != POLLING_BACKEND) {
+					std::unordered_set<std::string> splits;
+					if (survey(arg->path, arg->path.length(), splits)) {
+						expand(arg.get(), splits);
+					}
+				}
+				link(std::move(arg));
 			}
 		}
 
@@ -152,30 +441,163 @@ bool FileGuard::addPath(const std::string& path, bool subpath)
 
 void FileGuard::removePath(const std::string& path)
 {
-	for (auto iter = m_args.begin(); iter != m_args.end(); ++iter) {
-		if (iter->path == path) {
-			iter->release();
-			m_args.erase(iter);
-			break;
-		}
+	auto iter = m_index.find(normalize(path));
+	if (iter != m_index.end()) {
+		Arg* arg = iter->second;
+		cancel(arg);
+		arg->release();
+		unlink(arg);
 	}
 }
 
 void FileGuard::clearPaths()
 {
 	for (auto iter = m_args.begin(); iter != m_args.end(); ++iter) {
-		iter->release();
+		cancel(iter->get());
+		(*iter)->release();
 	}
 	m_args.clear();
+	m_index.clear();
+	m_tree.children.clear();
+	m_tree.arg = nullptr;
+	m_paths.clear();
 }
 
 std::map<std::string, bool> FileGuard::getPaths() const
 {
-	std::map<std::string, bool> map;
-	for (const auto& x : m_args) {
-		map.insert(std::make_pair(x.path, x.subpath));
+	return m_paths;
+}
+
+std::string FileGuard::findPath(const std::string& file) const
+{
+	std::vector<std::string> parts;
+	split(normalize(file, false), parts);
+
+	const Arg* found = nullptr;
+	const Node* node = &m_tree;
+	for (size_t i = 0; i < parts.size(); ++i) {
+		auto iter = node->children.find(parts[i]);
+		if (iter == node->children.end()) {
+			break;
+		}
+
+		node = iter->second.get();
+		//不监控子路径时,只覆盖其直接包含的文件
+		if (node->arg && (node->arg->option.subpath || i + 2 == parts.size())) {
+			found = node->arg;
+		}
+	}
+	return found ? found->path : std::string();
+}
+
+std::vector<std::string> FileGuard::getNestedPaths(const std::string& path) const
+{
+	std::vector<std::string> parts, result;
+	split(normalize(path), parts);
+
+	const Node* node = &m_tree;
+	for (const auto& x : parts) {
+		auto iter = node->children.find(x);
+		if (iter == node->children.end()) {
+			return result;
+		}
+		node = iter->second.get();
+	}
+
+	std::vector<const Node*> stack(1, node);
+	while (!stack.empty()) {
+		node = stack.back();
+		stack.pop_back();
+		if (node->arg) {
+			result.push_back(node->arg->path);
+		}
+
+		for (const auto& x : node->children) {
+			stack.push_back(x.second.get());
+		}
+	}
+	return result;
+}
+
+bool FileGuard::setAggregate(const std::string& path, bool aggregate)
+{
+	auto iter = m_index.find(normalize(path));
+	if (iter == m_index.end()) {
+		setLastError("%s路径不存在", path.c_str());
+		return false;
+	}
+
+	//目录摘要由投递线程定期交付,监控期间开启时按需启动投递线程
+	if (aggregate && m_start && !m_scheduler.joinable()) {
+		m_scheduleQuit = false;
+		m_scheduler = std::thread(&FileGuard::schedule, this);
+	}
+	m_schedule = m_schedule || aggregate;
+
+	std::lock_guard<std::mutex> lock(m_loopMutex);
+	iter->second->option.aggregate = aggregate;
+	iter->second->manual = aggregate;
+	return true;
+}
+
+void FileGuard::link(std::unique_ptr<Arg> arg)
+{
+	arg->key = normalize(arg->path);
+	arg->slot = m_args.size();
+
+	std::vector<std::string> parts;
+	split(arg->key, parts);
+	Node* node = &m_tree;
+	for (const auto& x : parts) {
+		std::unique_ptr<Node>& child = node->children[x];
+		if (!child) {
+			child.reset(new Node);
+		}
+		node = child.get();
+	}
+	node->arg = arg.get();
+
+	m_index[arg->key] = arg.get();
+	m_paths[arg->path] = arg->option.subpath;
+	m_args.push_back(std::move(arg));
+}
+
+void FileGuard::unlink(Arg* arg)
+{
+	std::vector<std::string> parts;
+	split(arg->key, parts);
+
+	//记录路径上的节点,自下而上删除不再使用的节点
+	std::vector<Node*> nodes(1, &m_tree);
+	for (const auto& x : parts) {
+		auto iter = nodes.back()->children.find(x);
+		if (iter == nodes.back()->children.end()) {
+			break;
+		}
+		nodes.push_back(iter->second.get());
+	}
+
+	if (nodes.size() == parts.size() + 1) {
+		nodes.back()->arg = nullptr;
+		for (size_t i = parts.size(); i > 0; --i) {
+			Node* node = nodes[i];
+			if (node->arg || !node->children.empty()) {
+				break;
+			}
+			nodes[i - 1]->children.erase(parts[i - 1]);
+		}
+	}
+
+	m_index.erase(arg->key);
+	m_paths.erase(arg->path);
+
+	//与末尾元素交换后删除,保持O(1)
+	const size_t slot = arg->slot;
+	if (slot + 1 != m_args.size()) {
+		std::swap(m_args[slot], m_args.back());
+		m_args[slot]->slot = slot;
 	}
-	return map;
+	m_args.pop_back();
 }
 
 void FileGuard::start()
@@ -184,222 +606,1957 @@ void FileGuard::start()
 		m_suffixes.clear();
 	}
 
+	m_schedule = m_schedule || std::any_of(m_args.begin(), m_args.end(), [](const std::unique_ptr<Arg>& x) {
+		return x->option.priority != 0 || x->option.rate > 0 || x->option.aggregate || x->option.aggregateRate > 0;
+	});
+
+	if (m_schedule && !m_scheduler.joinable()) {
+		m_scheduleQuit = false;
+		m_scheduler = std::thread(&FileGuard::schedule, this);
+	}
+
+	//stop会停止哈希线程池与扫描线程
+	if (m_content) {
+		m_hashPool.start(m_hashThreads);
+	}
+	m_surveyPool.start(1);
+
+	if (m_loops.empty()) {
+		const unsigned int count = (std::max)(1u, (std::min)(std::thread::hardware_concurrency(), 4u));
+		for (unsigned int i = 0; i < count; ++i) {
+			m_loops.emplace_back(&FileGuard::loop, this);
+		}
+	}
+
 	for (auto& x : m_args) {
-		if (!x.quit) {
-			if (m_pause && onStatus) {
-				onStatus(Status::STARTED, x.thread, x.path.c_str());
+		if (!x->quit && m_pause && onStatus) {
+			onStatus(Status::STARTED, x->thread, x->path.c_str());
+		}
+	}
+
+	std::vector<Arg*> args, notifies;
+	{
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		std::vector<Arg*> all;
+		for (auto& x : m_args) {
+			collect(x.get(), all);
+		}
+
+		for (auto x : all) {
+			if (x->quit && !x->detached) {
+				args.push_back(x);
 			}
-			continue;
 		}
 
-		x.future = std::async([&](Arg* arg)->void
-		{
-			arg->quit = false;
-			arg->thread = GetCurrentThreadId();
-			if (onStatus) {
-				onStatus(Status::STARTED, x.thread, x.path.c_str());
-			}
-
-			bool success = true;
-			DWORD bytes = 0, offset = 0, error = 0;
-			OVERLAPPED lapped = { 0 };
-			arg->lapped = static_cast<void*>(&lapped);
-			lapped.hEvent = arg->revent;
-			do {
-				memset(arg->buffer, 0, arg->size);
-				print("thread %lu,path %s,start ReadDirectoryChangesW\n", arg->thread, arg->path.c_str());
-				if (ReadDirectoryChangesW(arg->file,
-					arg->buffer,
-					arg->size,
-					arg->subpath,
-					FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
-					&bytes,
-					&lapped,
-					nullptr)) {
-					print("thread %lu,path %s,start GetOverlappedResult\n", arg->thread, arg->path.c_str());
-					if (GetOverlappedResult(arg->file, &lapped, &bytes, TRUE)) {
-						FILE_NOTIFY_INFORMATION* info = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(arg->buffer);
-						do {
-							if (!m_pause && onChanged) {
-								std::wstring ws(info->FileName, info->FileNameLength / sizeof(wchar_t));
-								std::string s(arg->path + unicode2ansi(ws));
-
-								if (!m_suffixes.empty()) {
-									for (size_t i = 0; i < m_suffixes.size(); ++i) {
-										size_t npos = s.find_last_of('.');
-										if (npos != std::string::npos) {
-											std::string suffix = s.substr(npos);
-											std::transform(suffix.begin(), suffix.end(), suffix.begin(), std::tolower);
-											if (suffix == m_suffixes[i]) {
-												onChanged(info->Action, s.c_str());
-												break;
-											}
-										}
-									}
-								}
-								else {
-									onChanged(info->Action, s.c_str());
-								}
-							}
-							offset = info->NextEntryOffset;
-							info = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(reinterpret_cast<uint8_t*>(info) + offset);
-						} while (offset);
-					}
-					else {
-						arg->ecode = GetLastError();
-						print("thread %lu,path %s,GetOverlappedResult false,error %lu\n",
-							arg->thread, arg->path.c_str(), arg->ecode);
-						if (arg->ecode == ERROR_OPERATION_ABORTED) {
-							arg->ecode = 0;
-							break;
-						}
-						success = false;
-					}
+		const uint64_t now = monotonic();
+		m_startTick = now;
+		for (auto x : args) {
+			x->quit = false;
+			x->cancel = false;
+			x->launched = false;
+			x->tokens = x->option.burst > 0 ? x->option.burst : x->option.rate;
+			x->refill = now;
+			x->window = now;
+			x->events = 0;
+			x->aggregating = false;
+			x->manual = x->option.aggregate;
+
+			//轮询的路径交给轮询线程,每次启动重新建立基准
+			if (x->snapshot) {
+				x->snapshot->due = 0;
+				x->snapshot->interval = 0;
+				x->snapshot->baseline = false;
+				m_polls.push_back(x);
+				m_sweepWake = true;
+			}
+			else {
+				notifies.push_back(x);
+			}
+		}
+		m_running += args.size();
+		m_starting += notifies.size();
+		if (notifies.empty()) {
+			m_startLatency = 0;
+		}
+	}
 
-					print("thread %lu,path %s,start ResetEvent\n", arg->thread, arg->path.c_str());
-					if (!ResetEvent(lapped.hEvent)) {
-						arg->ecode = GetLastError();
-						print("thread %lu,path %s,ResetEvent false,error %lu\n",
-							arg->thread, arg->path.c_str(), arg->ecode);
-						success = false;
-						break;
-					}
+	if (notifies.size() != args.size()) {
+		if (!m_scanThreads) {
+			m_scanThreads = (std::max)(2u, (std::min)(std::thread::hardware_concurrency(), 8u));
+			m_scanPool.start(m_scanThreads);
+		}
+
+		if (!m_sweeper.joinable()) {
+			m_sweepQuit = false;
+			m_sweeper = std::thread(&FileGuard::sweep, this);
+		}
+		m_loopCond.notify_all();
+	}
+
+	//由各事件循环线程并行投递首次读取
+	for (auto x : notifies) {
+		PostQueuedCompletionStatus(m_port, 0, reinterpret_cast<ULONG_PTR>(x), nullptr);
+	}
+	m_start = true;
+	m_pause = false;
+}
+
+void FileGuard::pause()
+{
+	if (onStatus && !m_pause) {
+		for (auto& x : m_args) {
+			onStatus(Status::PAUSED, x->thread, x->path.c_str());
+		}
+	}
+	m_pause = true;
+	m_start = false;
+}
+
+void FileGuard::stop()
+{
+	const uint64_t tick = monotonic();
+	m_start = false;
+	m_pause = false;
+
+	{
+		//先向所有路径发出取消,再统一等待,耗时取决于最慢的路径而非路径个数
+		std::unique_lock<std::mutex> lock(m_loopMutex);
+		std::vector<Arg*> args;
+		for (auto& x : m_args) {
+			collect(x.get(), args);
+		}
+
+		for (auto x : args) {
+			if (!x->quit && !x->cancel) {
+				x->cancel = true;
+				if (x->snapshot) {
+					m_sweepWake = true;
 				}
 				else {
-					arg->ecode = GetLastError();
-					print("thread %lu,path %s,ReadDirectoryChangeW false,error %lu\n",
-						arg->thread, arg->path.c_str(), arg->ecode);
-					success = false;
-					break;
+					CancelIoEx(x->file, static_cast<LPOVERLAPPED>(x->lapped()));
 				}
-				print("thread %lu,path %s,start WaitForSingleObject\n", arg->thread, arg->path.c_str());
-				error = WaitForSingleObject(arg->wevent, 0);
-			} while (error == WAIT_TIMEOUT && !arg->quit);
+				trace(TRACE_CANCEL, 0, x->slot);
+			}
+		}
+		m_loopCond.notify_all();
 
-			if (onError && !success) {
-				onError(arg->ecode, arg->path.c_str());
+		if (!m_loopCond.wait_for(lock, std::chrono::milliseconds(STOP_TIMEOUT), [this]() { return m_running == 0; })) {
+			//关闭句柄会使其上所有未完成的读取立即结束,路径需要restart后才能继续监控
+			args.clear();
+			for (auto& x : m_args) {
+				collect(x.get(), args);
 			}
 
-			if (onStatus) {
-				onStatus(Status::STOPPED, arg->thread, arg->path.c_str());
+			for (auto x : args) {
+				if (!x->quit && x->file != INVALID_HANDLE_VALUE) {
+					print("path %s,stop timeout,close handle\n", x->path.c_str());
+					CloseHandle(x->file);
+					x->file = INVALID_HANDLE_VALUE;
+				}
 			}
-			print("thread %lu,path %s,thread exit\n", arg->thread, arg->path.c_str());
-			arg->quit = true;
-		}, &x);
+			m_loopCond.wait(lock, [this]() { return m_running == 0; });
+		}
 	}
-	m_start = true;
-	m_pause = false;
+
+	//已取消的监控不再启动子监控,执行完剩余的扫描即可
+	m_surveyPool.stop(true);
+
+	if (m_sweeper.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_loopMutex);
+			m_sweepQuit = true;
+		}
+		m_loopCond.notify_all();
+		m_sweeper.join();
+	}
+
+	//监控线程均已退出,执行完已投递的内容比较,其结果仍经调度线程交付,stop返回后不再回调
+	m_hashPool.stop(true);
+
+	//交付剩余事件与摘要后退出
+	if (m_scheduler.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_scheduleMutex);
+			m_scheduleQuit = true;
+		}
+		m_scheduleCond.notify_all();
+		m_scheduler.join();
+	}
+	m_schedule = false;
+	m_stopLatency = monotonic() - tick;
+}
+
+bool FileGuard::restart()
+{
+	stop();
+	std::vector<std::pair<std::string, Option>> paths;
+	for (const auto& x : m_args) {
+		paths.push_back(std::make_pair(x->path, x->option));
+	}
+
+	clearPaths();
+	for (const auto& x : paths) {
+		if (!addPath(x.first, x.second)) {
+			return false;
+		}
+	}
+	start();
+	return true;
+}
+
+uint64_t FileGuard::getStartLatency() const
+{
+	return m_startLatency;
+}
+
+uint64_t FileGuard::getStopLatency() const
+{
+	return m_stopLatency;
+}
+
+FileGuard::Statistics FileGuard::getStatistics() const
+{
+	Statistics statistics;
+	statistics.reads = m_counters.reads.load(std::memory_order_relaxed);
+	statistics.bytes = m_counters.bytes.load(std::memory_order_relaxed);
+	statistics.overflows = m_counters.overflows.load(std::memory_order_relaxed);
+	statistics.decoded = m_counters.decoded.load(std::memory_order_relaxed);
+	statistics.coalesced = m_counters.coalesced.load(std::memory_order_relaxed);
+	statistics.delivered = m_counters.delivered.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < sizeof(statistics.latencies) / sizeof(*statistics.latencies); ++i) {
+		statistics.latencies[i] = m_counters.latencies[i].load(std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		statistics.dropped = m_dropped;
+	}
+	return statistics;
+}
+
+void FileGuard::resetStatistics()
+{
+	m_counters.reads = 0;
+	m_counters.bytes = 0;
+	m_counters.overflows = 0;
+	m_counters.decoded = 0;
+	m_counters.coalesced = 0;
+	m_counters.delivered = 0;
+	for (auto& x : m_counters.latencies) {
+		x = 0;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_dropped = 0;
+}
+
+uint64_t FileGuard::getSequence() const
+{
+	return m_sequence.load(std::memory_order_relaxed);
 }
 
-void FileGuard::pause()
-{
-	if (onStatus && !m_pause) {
-		for (auto& x : m_args) {
-			onStatus(Status::PAUSED, x.thread, x.path.c_str());
+uint64_t FileGuard::getPercentile(const Statistics& statistics, double percentile)
+{
+	const size_t size = sizeof(statistics.latencies) / sizeof(*statistics.latencies);
+	uint64_t total = 0;
+	for (size_t i = 0; i < size; ++i) {
+		total += statistics.latencies[i];
+	}
+
+	if (!total) {
+		return 0;
+	}
+
+	const double target = total * (std::min)((std::max)(percentile, 0.0), 100.0) / 100.0;
+	uint64_t count = 0;
+	for (size_t i = 0; i < size; ++i) {
+		count += statistics.latencies[i];
+		if (count && count >= target) {
+			return 2ULL << i;
+		}
+	}
+	return 2ULL << (size - 1);
+}
+
+bool FileGuard::isStart() const
+{
+	return m_start;
+}
+
+const char* FileGuard::getLastError() const
+{
+	return m_error.c_str();
+}
+
+void FileGuard::addSuffix(const std::string& suffix)
+{
+	std::string data(suffix);
+	std::transform(data.begin(), data.end(), data.begin(), std::tolower);
+	bool find = false, add = false;
+	for (const auto& x : m_suffixes) {
+		if (x == data) {
+			find = true;
+			break;
+		}
+	}
+
+	if (!find) {
+		if (data.find_last_of('.') == std::string::npos) {
+			add = true;
+		}
+		m_suffixes.push_back(add ? "." + data : data);
+	}
+
+	for (const auto& x : m_suffixes) {
+		if (x == ALL_SUFFIXES || std::string(".") + x == ALL_SUFFIXES) {
+			m_suffixes.clear();
+			m_suffixes.push_back(ALL_SUFFIXES);
+			break;
+		}
+	}
+}
+
+void FileGuard::addSuffixes(const std::vector<std::string>& suffixes)
+{
+	m_suffixes = suffixes;
+}
+
+void FileGuard::removeSuffix(const std::string& suffix)
+{
+	std::string data(suffix);
+	std::transform(data.begin(), data.end(), data.begin(), std::tolower);
+	for (auto iter = m_suffixes.begin(); iter != m_suffixes.end(); ++iter) {
+		if (*iter == data) {
+			m_suffixes.erase(iter);
+			break;
+		}
+	}
+}
+
+void FileGuard::removeSuffixes(const std::vector<std::string>& suffixes)
+{
+	for (auto iter = suffixes.begin(); iter != suffixes.end(); ++iter) {
+		std::string data(*iter);
+		std::transform(data.begin(), data.end(), data.begin(), std::tolower);
+		m_suffixes.erase(std::remove(m_suffixes.begin(), m_suffixes.end(), data), m_suffixes.end());
+	}
+}
+
+void FileGuard::clearSuffixes()
+{
+	m_suffixes.clear();
+}
+
+std::vector<std::string> FileGuard::getSuffixes() const
+{
+	return m_suffixes;
+}
+
+void FileGuard::addExclude(const std::string& rule)
+{
+	std::string data = normalize(rule, false);
+	const size_t begin = data.find_first_not_of('\\');
+	const size_t end = data.find_last_not_of('\\');
+	if (begin == std::string::npos) {
+		return;
+	}
+
+	data = data.substr(begin, end - begin + 1);
+	if (std::find(m_excludes.begin(), m_excludes.end(), data) == m_excludes.end()) {
+		m_excludes.push_back(data);
+	}
+}
+
+void FileGuard::removeExclude(const std::string& rule)
+{
+	std::string data = normalize(rule, false);
+	const size_t begin = data.find_first_not_of('\\');
+	const size_t end = data.find_last_not_of('\\');
+	if (begin != std::string::npos) {
+		data = data.substr(begin, end - begin + 1);
+		m_excludes.erase(std::remove(m_excludes.begin(), m_excludes.end(), data), m_excludes.end());
+	}
+}
+
+void FileGuard::clearExcludes()
+{
+	m_excludes.clear();
+}
+
+std::vector<std::string> FileGuard::getExcludes() const
+{
+	return m_excludes;
+}
+
+void FileGuard::setPollMode(bool enable, size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (enable) {
+		if (!m_event) {
+			m_event = CreateEventA(nullptr, true, false, nullptr);
+		}
+		m_capacity = capacity;
+		m_pending.entries.reserve((std::min<size_t>)(capacity, 64 * 1024));
+	}
+	else {
+		m_pending.clear();
+		m_drain.clear();
+		if (m_event) {
+			CloseHandle(m_event);
+			m_event = nullptr;
+		}
+	}
+	m_poll = enable && m_event;
+}
+
+size_t FileGuard::poll(Event* events, size_t count, char* buffer, size_t size, uint32_t timeout)
+{
+	size_t result = 0, used = 0;
+	do {
+		if (!m_poll || !events || !count || !buffer || !size) {
+			break;
+		}
+
+		//读取队列取完后,整体交换待取队列,每批只加锁一次
+		for (int i = 0; i < 2 && m_drain.index == m_drain.entries.size(); ++i) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_pending.entries.empty()) {
+					m_drain.clear();
+					std::swap(m_pending, m_drain);
+					break;
+				}
+			}
+
+			if (i || !timeout || WaitForSingleObject(m_event, timeout) != WAIT_OBJECT_0) {
+				break;
+			}
+		}
+
+		while (result < count && m_drain.index < m_drain.entries.size()) {
+			const Entry& entry = m_drain.entries[m_drain.index];
+			const uint32_t length = entry.event.length;
+			if (used + length + 1 > size) {
+				break;
+			}
+
+			memcpy(buffer + used, m_drain.data.data() + entry.offset, length);
+			buffer[used + length] = 0;
+
+			Event& event = events[result++];
+			event = entry.event;
+			event.file = buffer + used;
+
+			used += length + 1;
+			++m_drain.index;
+		}
+
+		//句柄有信号当且仅当还有未取出的事件
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_drain.index == m_drain.entries.size() && m_pending.entries.empty()) {
+			ResetEvent(m_event);
+		}
+		else {
+			SetEvent(m_event);
+		}
+	} while (false);
+	return result;
+}
+
+void* FileGuard::getPollHandle() const
+{
+	return m_poll ? m_event : nullptr;
+}
+
+uint64_t FileGuard::getPollDropped() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dropped;
+}
+
+void FileGuard::setContentFilter(bool enable, uint64_t limit, size_t threads)
+{
+	m_hashPool.stop();
+	m_content = enable;
+	m_limit = limit;
+	m_hashThreads = threads ? threads : 1;
+
+	std::lock_guard<std::mutex> lock(m_fingerprintMutex);
+	m_fingerprints.clear();
+	m_comparing.clear();
+	if (enable) {
+		m_hashPool.start(m_hashThreads);
+	}
+}
+
+void FileGuard::setMetadata(bool enable)
+{
+	m_metadata = enable;
+}
+
+void FileGuard::setIntern(bool enable)
+{
+	m_intern = enable;
+}
+
+const char* FileGuard::getDirectory(uint32_t id) const
+{
+	return m_interner.lookup(id);
+}
+
+std::string FileGuard::getPath(const Event& event) const
+{
+	std::string result;
+	const char* dir = m_interner.lookup(event.directory);
+	if (dir) {
+		result = dir;
+	}
+
+	if (event.file) {
+		result.append(event.file, event.length);
+	}
+	return result;
+}
+
+void FileGuard::loop()
+{
+	//与BasicFileGuard共用完成端口循环,此处只处理各类完成包
+	struct Handler
+	{
+		FileGuard* guard;
+		unsigned long thread;
+		uint64_t completed;
+		bool stopped;
+
+		bool running() const
+		{
+			return !stopped;
+		}
+
+		void dequeued()
+		{
+			//同一批完成包共用取出时的时间戳,解码与回调的耗时不计入其中
+			completed = monotonic();
+		}
+
+		void start(ULONG_PTR key)
+		{
+			Arg* arg = reinterpret_cast<Arg*>(key);
+			arg->thread = thread;
+			if (guard->onStatus && !arg->parent) {
+				guard->onStatus(Status::STARTED, arg->thread, arg->path.c_str());
+			}
+			print("thread %lu,path %s,start ReadDirectoryChangesW\n", arg->thread, arg->path.c_str());
+			//失败时finish可能回收分离的子监控,之后不能再访问arg
+			const bool launched = arg->launched;
+			arg->block = guard->m_blocks.acquire();
+			if (arg->block) {
+				guard->resume(arg);
+			}
+			else {
+				guard->finish(arg, ERROR_NOT_ENOUGH_MEMORY);
+			}
+
+			std::lock_guard<std::mutex> lock(guard->m_loopMutex);
+			if (!launched && --guard->m_starting == 0) {
+				guard->m_startLatency = monotonic() - guard->m_startTick;
+			}
+		}
+
+		void* file(ULONG_PTR key) const
+		{
+			return reinterpret_cast<Arg*>(key)->file;
+		}
+
+		void complete(ULONG_PTR key, DWORD bytes, DWORD ecode)
+		{
+			Arg* arg = reinterpret_cast<Arg*>(key);
+			arg->thread = thread;
+			if (ecode && ecode != ERROR_NOTIFY_ENUM_DIR) {
+				print("thread %lu,path %s,GetOverlappedResult false,error %lu\n", arg->thread, arg->path.c_str(), ecode);
+				guard->finish(arg, ecode == ERROR_OPERATION_ABORTED ? 0 : ecode);
+				return;
+			}
+
+			trace(TRACE_READ_COMPLETED, 0, bytes);
+			guard->m_counters.reads.fetch_add(1, std::memory_order_relaxed);
+			guard->m_counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+			if (ecode) {
+				//缓冲区溢出时内核丢弃了本次读取期间的所有变化,缓冲区中仍是上次的内容,不能解码
+				guard->m_counters.overflows.fetch_add(1, std::memory_order_relaxed);
+				print("thread %lu,path %s,buffer overflow\n", arg->thread, arg->path.c_str());
+				if (guard->onError) {
+					guard->onError(ERROR_NOTIFY_ENUM_DIR, arg->path.c_str());
+				}
+
+				//溢出期间新建或删除的子目录没有记录,拆分后的监控须重新扫描子目录
+				if (arg->option.subpath && !arg->recursive) {
+					guard->rescan(arg);
+				}
+				guard->resume(arg);
+				return;
+			}
+
+			//拆分后的监控需感知子目录的增删,暂停时同样调整
+			if (arg->option.subpath && !arg->recursive) {
+				guard->adjust(arg);
+			}
+
+			if (!guard->m_pause && (guard->onChanged || guard->onChangedEx || guard->m_poll)) {
+				guard->decode(arg, completed);
+			}
+			guard->resume(arg);
+		}
+
+		void quit(ULONG count)
+		{
+			//每个线程只消费一个退出包,多取的交还给其他线程
+			stopped = true;
+			for (ULONG i = 1; i < count; ++i) {
+				PostQueuedCompletionStatus(guard->m_port, 0, 0, nullptr);
+			}
+		}
+	};
+
+	Handler handler = { this, GetCurrentThreadId(), 0, false };
+	const DWORD ecode = pumpCompletions(m_port, handler);
+	if (ecode) {
+		print("thread %lu,GetQueuedCompletionStatusEx false,error %lu\n", handler.thread, ecode);
+	}
+	print("thread %lu,thread exit\n", handler.thread);
+}
+
+void FileGuard::resume(Arg* arg)
+{
+	unsigned long ecode = 0;
+	{
+		//与stop互斥,避免在取消之后才投递读取
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		if (!arg->cancel && arg->read()) {
+			trace(TRACE_READ_ISSUED, 0, 0);
+			return;
+		}
+		ecode = arg->cancel ? 0 : arg->ecode;
+	}
+	print("thread %lu,path %s,ReadDirectoryChangeW stop,error %lu\n", arg->thread, arg->path.c_str(), ecode);
+	finish(arg, ecode);
+}
+
+void FileGuard::finish(Arg* arg, unsigned long ecode)
+{
+	arg->ecode = ecode;
+	//子监控的目录可能随时被删除,其错误与状态不上报
+	if (onError && ecode && !arg->parent) {
+		onError(arg->ecode, arg->path.c_str());
+	}
+
+	if (onStatus && !arg->parent) {
+		onStatus(Status::STOPPED, arg->thread, arg->path.c_str());
+	}
+
+	m_blocks.release(arg->block);
+	arg->block = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		arg->quit = true;
+		--m_running;
+		if (arg->detached) {
+			reap(arg);
+		}
+	}
+	m_loopCond.notify_all();
+}
+
+void FileGuard::cancel(Arg* arg)
+{
+	std::unique_lock<std::mutex> lock(m_loopMutex);
+	std::vector<Arg*> args;
+	collect(arg, args);
+	for (auto x : args) {
+		if (!x->quit && !x->cancel) {
+			x->cancel = true;
+			if (x->snapshot) {
+				m_sweepWake = true;
+			}
+			else {
+				CancelIoEx(x->file, static_cast<LPOVERLAPPED>(x->lapped()));
+			}
+			trace(TRACE_CANCEL, 0, x->slot);
+		}
+	}
+	m_loopCond.notify_all();
+	m_loopCond.wait(lock, [arg]() { return idle(arg); });
+}
+
+void FileGuard::collect(Arg* arg, std::vector<Arg*>& args)
+{
+	args.push_back(arg);
+	for (auto& x : arg->children) {
+		collect(x.get(), args);
+	}
+}
+
+bool FileGuard::idle(const Arg* arg)
+{
+	if (!arg->quit || arg->pending) {
+		return false;
+	}
+
+	for (const auto& x : arg->children) {
+		if (!idle(x.get())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FileGuard::excluded(const std::string& relative) const
+{
+	if (m_excludes.empty()) {
+		return false;
+	}
+
+	const std::string key = normalize(relative, false);
+	std::vector<std::string> parts;
+	split(key, parts);
+	for (const auto& x : m_excludes) {
+		//目录名匹配任意层级,相对路径从监控路径开始匹配
+		if (x.find('\\') == std::string::npos) {
+			if (std::find(parts.begin(), parts.end(), x) != parts.end()) {
+				return true;
+			}
+		}
+		else if (key.compare(0, x.length(), x) == 0 && (key.length() == x.length() || key[x.length()] == '\\')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FileGuard::survey(const std::string& dir, size_t offset, std::unordered_set<std::string>& splits) const
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileExA((dir + "*").c_str(), FindExInfoBasic, &data,
+		FindExSearchLimitToDirectories, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+	if (find == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	bool result = false;
+	do {
+		//跳过非目录与重解析点(递归监控同样不会跟随)
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+			(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ||
+			!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+			continue;
+		}
+
+		const std::string sub = dir + data.cFileName + "\\";
+		if (excluded(sub.substr(offset))) {
+			result = true;
+		}
+		else if (survey(sub, offset, splits)) {
+			result = true;
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+
+	if (result) {
+		splits.insert(normalize(dir));
+	}
+	return result;
+}
+
+void FileGuard::expand(Arg* arg, const std::unordered_set<std::string>& splits)
+{
+	//只监控自身,需要目录名通知以便感知新建与移入的子目录
+	//未订阅目录名时记录现有子目录,以便在解码时分辨并丢弃强制订阅产生的记录
+	arg->recursive = false;
+	arg->filter |= FILE_NOTIFY_CHANGE_DIR_NAME;
+	const bool forced = !(arg->option.mask & DIR_NAME_MASK);
+
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileExA((arg->path + "*").c_str(), FindExInfoBasic, &data,
+		FindExSearchLimitToDirectories, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+	if (find == INVALID_HANDLE_VALUE) {
+		return;
+	}
+
+	do {
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+			!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+			continue;
+		}
+
+		const std::string name = data.cFileName;
+		if (forced) {
+			arg->subdirs.insert(normalize(arg->path + name));
+		}
+
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+			continue;
+		}
+
+		if (!excluded((arg->path + name).substr(arg->root->path.length()))) {
+			attach(arg, name, splits);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+}
+
+FileGuard::Arg* FileGuard::attach(Arg* arg, const std::string& name, const std::unordered_set<std::string>& splits)
+{
+	std::unique_ptr<Arg> child(new Arg);
+	std::string error;
+	if (!child->create(arg->path + name, arg->root->option, m_port, error)) {
+		print("%s\n", error.c_str());
+		return nullptr;
+	}
+
+	child->key = normalize(child->path);
+	child->root = arg->root;
+	child->parent = arg;
+	if (splits.count(child->key)) {
+		expand(child.get(), splits);
+	}
+
+	Arg* result = child.get();
+	std::lock_guard<std::mutex> lock(m_loopMutex);
+	arg->children.push_back(std::move(child));
+	return result;
+}
+
+void FileGuard::adjust(Arg* arg)
+{
+	struct NameFilter
+	{
+		bool operator()(uint32_t action, const std::string&) const
+		{
+			return action == Action::ADDED || action == Action::REMOVED ||
+				action == Action::RENAMED_OLD_NAME || action == Action::RENAMED_NEW_NAME;
+		}
+	};
+
+	struct NameSink
+	{
+		std::vector<std::pair<uint32_t, std::string>>& names;
+
+		void operator()(uint32_t action, std::string& file)
+		{
+			names.emplace_back(action, file);
+		}
+	};
+
+	std::vector<std::pair<uint32_t, std::string>> names;
+	std::string file;
+	NameFilter filter;
+	NameSink sink = { names };
+	BasicFileGuard<NameFilter, NameSink, AnsiEncoding>::decode(arg->path, arg->buffer(), filter, sink, file);
+
+	const bool forced = !(arg->option.mask & DIR_NAME_MASK);
+	arg->skips.clear();
+	bool added = false;
+	for (const auto& x : names) {
+		const std::string key = normalize(x.second);
+		if (x.first == Action::REMOVED || x.first == Action::RENAMED_OLD_NAME) {
+			std::lock_guard<std::mutex> lock(m_loopMutex);
+			if (forced && arg->subdirs.erase(key)) {
+				arg->skips.push_back(x);
+			}
+
+			for (auto& y : arg->children) {
+				if (y->key == key && !y->detached) {
+					detach(y.get());
+					break;
+				}
+			}
+			continue;
+		}
+
+		//新建或移入的目录,由扫描线程按规则重新评估
+		const DWORD attributes = GetFileAttributesA(x.second.c_str());
+		if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			continue;
+		}
+
+		if (forced) {
+			std::lock_guard<std::mutex> lock(m_loopMutex);
+			arg->subdirs.insert(key);
+			arg->skips.push_back(x);
+		}
+
+		if (!(attributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+			added = true;
+		}
+	}
+
+	if (added) {
+		rescan(arg);
+	}
+}
+
+void FileGuard::rescan(Arg* arg)
+{
+	std::lock_guard<std::mutex> lock(m_loopMutex);
+	if (arg->rescan || arg->cancel || arg->detached) {
+		return;
+	}
+
+	arg->rescan = true;
+	++arg->pending;
+	if (!m_surveyPool.post([this, arg]() { resync(arg); })) {
+		arg->rescan = false;
+		--arg->pending;
+	}
+}
+
+void FileGuard::resync(Arg* arg)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		arg->rescan = false;
+	}
+
+	//只列出直接子目录,新增子目录的遍历在创建子监控时进行
+	std::vector<std::pair<std::string, bool>> dirs;
+	std::unordered_set<std::string> keys;
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileExA((arg->path + "*").c_str(), FindExInfoBasic, &data,
+		FindExSearchLimitToDirectories, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+				!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+				continue;
+			}
+			dirs.emplace_back(data.cFileName, (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0);
+			keys.insert(normalize(arg->path + data.cFileName));
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+
+	const bool forced = !(arg->option.mask & DIR_NAME_MASK);
+	const size_t offset = arg->root->path.length();
+	{
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		if (find != INVALID_HANDLE_VALUE && !arg->cancel && !arg->detached) {
+			if (forced) {
+				for (auto iter = arg->subdirs.begin(); iter != arg->subdirs.end();) {
+					iter = keys.count(*iter) ? std::next(iter) : arg->subdirs.erase(iter);
+				}
+				arg->subdirs.insert(keys.begin(), keys.end());
+			}
+
+			//分离已删除或移出的子目录(回收只会移除已结束的子监控,先收集再分离)
+			std::vector<Arg*> stale;
+			for (auto& x : arg->children) {
+				if (!x->detached && !keys.count(x->key)) {
+					stale.push_back(x.get());
+				}
+			}
+
+			for (auto x : stale) {
+				detach(x);
+			}
+		}
+		else {
+			dirs.clear();
+		}
+	}
+
+	for (const auto& x : dirs) {
+		const std::string sub = arg->path + x.first + "\\";
+		if (x.second || excluded(sub.substr(offset))) {
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_loopMutex);
+			if (arg->cancel || arg->detached) {
+				break;
+			}
+
+			const std::string key = normalize(arg->path + x.first);
+			if (std::any_of(arg->children.begin(), arg->children.end(), [&key](const std::unique_ptr<Arg>& y) {
+				return y->key == key && !y->detached;
+			})) {
+				continue;
+			}
+		}
+
+		std::unordered_set<std::string> splits;
+		survey(sub, offset, splits);
+		Arg* child = attach(arg, x.first, splits);
+		if (child) {
+			launch(child);
+		}
+	}
+
+	{
+		//扫描期间目录被删除时,连同刚创建的子监控一并分离,结束后回收
+		std::lock_guard<std::mutex> lock(m_loopMutex);
+		--arg->pending;
+		if (arg->detached) {
+			detach(arg);
+		}
+	}
+	m_loopCond.notify_all();
+}
+
+void FileGuard::launch(Arg* arg)
+{
+	std::lock_guard<std::mutex> lock(m_loopMutex);
+	if (arg->parent->quit || arg->parent->cancel || arg->detached) {
+		return;
+	}
+
+	std::vector<Arg*> args;
+	collect(arg, args);
+	const uint64_t now = monotonic();
+	for (auto x : args) {
+		x->quit = false;
+		x->cancel = false;
+		x->launched = true;
+		x->tokens = 0;
+		x->refill = now;
+		PostQueuedCompletionStatus(m_port, 0, reinterpret_cast<ULONG_PTR>(x), nullptr);
+	}
+	m_running += args.size();
+}
+
+void FileGuard::detach(Arg* arg)
+{
+	std::vector<Arg*> args, leaves;
+	collect(arg, args);
+	for (auto x : args) {
+		x->detached = true;
+		if (!x->quit && !x->cancel) {
+			x->cancel = true;
+			CancelIoEx(x->file, static_cast<LPOVERLAPPED>(x->lapped()));
+		}
+
+		if (x->children.empty()) {
+			leaves.push_back(x);
+		}
+	}
+
+	//只从叶子向上回收,回收一个叶子不会释放其他叶子
+	for (auto x : leaves) {
+		reap(x);
+	}
+}
+
+void FileGuard::reap(Arg* arg)
+{
+	while (arg->parent && arg->detached && arg->quit && !arg->pending && arg->children.empty()) {
+		Arg* parent = arg->parent;
+		for (auto iter = parent->children.begin(); iter != parent->children.end(); ++iter) {
+			if (iter->get() == arg) {
+				parent->children.erase(iter);
+				break;
+			}
+		}
+		arg = parent;
+	}
+}
+
+void FileGuard::decode(Arg* arg, uint64_t timestamp)
+{
+	//写入批次的接收器
+	struct BatchSink
+	{
+		std::vector<Change>& batch;
+		size_t count;
+		uint64_t timestamp;
+		int priority;
+
+		void operator()(uint32_t action, std::string& file)
+		{
+			if (count == batch.size()) {
+				batch.emplace_back();
+			}
+
+			Change& change = batch[count++];
+			change.file.swap(file);
+			change.event = Event();
+			change.event.action = action;
+			change.event.timestamp = timestamp;
+			change.priority = priority;
+		}
+	};
+
+	thread_local std::vector<Change> batch;
+	thread_local std::string file;
+	const uint64_t tick = traceTick();
+
+	//内核无法区分的动作(如只订阅添加时的删除)在此过滤
+	//被排除的路径(如递归监控中新出现的同名目录)在此尽早丢弃
+	struct ActionFilter
+	{
+		const FileGuard* guard;
+		const Arg* arg;
+
+		bool operator()(uint32_t action, const std::string& file) const
+		{
+			return guard->accept(arg, action, file);
+		}
+	};
+
+	ActionFilter filter = { this, arg };
+	BatchSink sink = { batch, 0, timestamp, arg->option.priority };
+	BasicFileGuard<ActionFilter, BatchSink, AnsiEncoding>::decode(arg->path, arg->buffer(), filter, sink, file);
+	const size_t count = sink.count;
+	trace(TRACE_DECODE, tick, count);
+	submit(arg, batch.data(), count);
+}
+
+bool FileGuard::accept(const Arg* arg, uint32_t action, const std::string& file) const
+{
+	//拆分后强制订阅的目录名记录只用于调整子监控,不交付给未订阅目录名的调用者
+	if (!arg->skips.empty() && action != Action::MODIFIED &&
+		std::find(arg->skips.begin(), arg->skips.end(), std::make_pair(action, file)) != arg->skips.end()) {
+		return false;
+	}
+
+	SuffixFilter suffix;
+	suffix.suffixes = &m_suffixes;
+	return action < 32 && (arg->option.actions >> action & 1) && suffix(action, file) &&
+		(m_excludes.empty() || !excluded(file.substr(arg->root->path.length())));
+}
+
+void FileGuard::submit(Arg* arg, Change* changes, size_t count)
+{
+	//合并为目录摘要时只需要目录与动作,不再填充元数据
+	const bool aggregating = aggregate(arg, count);
+	m_counters.decoded.fetch_add(count, std::memory_order_relaxed);
+
+	//每批只取一次序号,批内连续
+	const uint64_t sequence = m_sequence.fetch_add(count, std::memory_order_relaxed);
+	for (size_t i = 0; i < count; ++i) {
+		changes[i].event.sequence = sequence + i + 1;
+	}
+
+	if (aggregating) {
+		m_counters.coalesced.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	if (m_metadata && !aggregating) {
+		enrich(changes, count);
+	}
+
+	//拆分后根与子监控、轮询的各扫描线程共用根的令牌桶,可能在多个线程中同时取用
+	Arg* root = arg->root;
+	for (size_t i = 0; i < count; ++i) {
+		if (aggregating) {
+			coalesce(changes[i], root->path);
+			continue;
+		}
+
+		if (root->option.rate > 0) {
+			bool take = false;
+			if (arg->exclusive()) {
+				take = root->take();
+			}
+			else {
+				std::lock_guard<std::mutex> lock(m_loopMutex);
+				take = root->take();
+			}
+
+			if (!take) {
+				m_counters.coalesced.fetch_add(1, std::memory_order_relaxed);
+				coalesce(changes[i], root->path);
+				continue;
+			}
+		}
+		notify(changes[i]);
+	}
+}
+
+void FileGuard::sweep()
+{
+	const unsigned long thread = GetCurrentThreadId();
+	while (true) {
+		std::vector<Arg*> due, done;
+		{
+			std::unique_lock<std::mutex> lock(m_loopMutex);
+			const uint64_t now = GetTickCount64();
+			uint64_t wait = MAX_INTERVAL;
+			for (auto iter = m_polls.begin(); iter != m_polls.end();) {
+				Arg* x = *iter;
+				if (x->cancel) {
+					done.push_back(x);
+					iter = m_polls.erase(iter);
+					continue;
+				}
+
+				if (x->snapshot->due <= now) {
+					due.push_back(x);
+				}
+				else {
+					wait = (std::min)(wait, x->snapshot->due - now);
+				}
+				++iter;
+			}
+
+			if (due.empty() && done.empty()) {
+				if (m_sweepQuit) {
+					break;
+				}
+
+				m_loopCond.wait_for(lock, std::chrono::milliseconds(wait), [this]() { return m_sweepQuit || m_sweepWake; });
+				m_sweepWake = false;
+				continue;
+			}
+		}
+
+		for (auto x : done) {
+			{
+				std::lock_guard<std::mutex> lock(x->snapshot->mutex);
+				x->snapshot->folders.clear();
+			}
+			print("thread %lu,path %s,polling stop\n", thread, x->path.c_str());
+			finish(x, 0);
+		}
+
+		for (auto x : due) {
+			x->thread = thread;
+			if (!x->snapshot->baseline) {
+				if (onStatus && !x->parent) {
+					onStatus(Status::STARTED, x->thread, x->path.c_str());
+				}
+				print("thread %lu,path %s,polling start\n", thread, x->path.c_str());
+			}
+			scan(x);
+		}
+	}
+	print("thread %lu,thread exit\n", thread);
+}
+
+void FileGuard::scan(Arg* arg)
+{
+	//并行遍历,工作者从共享栈中取出目录,列举后将子目录压回
+	struct Walk
+	{
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::vector<std::string> stack;
+		size_t active = 0;
+		size_t workers = 0;
+		uint64_t entries = 0;
+		uint64_t changes = 0;
+	};
+
+	Snapshot* snapshot = arg->snapshot.get();
+	const uint64_t begin = monotonic();
+	auto walk = std::make_shared<Walk>();
+	walk->stack.push_back(std::string());
+
+	auto work = [this, arg, walk]() {
+		std::vector<std::string> dirs;
+		std::vector<Change> batch;
+		std::unique_lock<std::mutex> lock(walk->mutex);
+		while (true) {
+			walk->cond.wait(lock, [&walk]() { return !walk->stack.empty() || !walk->active; });
+			if (walk->stack.empty() || arg->cancel) {
+				walk->stack.clear();
+				break;
+			}
+
+			const std::string relative = std::move(walk->stack.back());
+			walk->stack.pop_back();
+			++walk->active;
+			lock.unlock();
+
+			dirs.clear();
+			batch.clear();
+			const size_t entries = list(arg, relative, dirs, batch);
+			if (!batch.empty() && !m_pause) {
+				submit(arg, batch.data(), batch.size());
+			}
+
+			lock.lock();
+			walk->entries += entries;
+			walk->changes += batch.size();
+			for (auto& x : dirs) {
+				walk->stack.push_back(std::move(x));
+			}
+			--walk->active;
+			walk->cond.notify_all();
+		}
+		--walk->workers;
+		walk->cond.notify_all();
+	};
+
+	//并行度随目录树规模增长,首次扫描规模未知时使用全部扫描线程
+	const size_t degree = snapshot->baseline ?
+		(std::min)(m_scanThreads, static_cast<size_t>(snapshot->entries / 50000 + 1)) : m_scanThreads;
+	walk->workers = degree;
+	for (size_t i = 1; i < degree; ++i) {
+		m_scanPool.post(work);
+	}
+	work();
+
+	{
+		std::unique_lock<std::mutex> lock(walk->mutex);
+		walk->cond.wait(lock, [&walk]() { return walk->workers == 0; });
+	}
+
+	//有变化时缩短间隔,无变化时逐渐放宽,扫描耗时不超过间隔的十分之一
+	const uint64_t cost = (monotonic() - begin) / 1000;
+	uint64_t interval = arg->option.interval;
+	if (!interval) {
+		interval = snapshot->interval ? snapshot->interval : MIN_INTERVAL;
+		interval = walk->changes ? interval / 2 : interval + interval / 2;
+		interval = (std::max)(interval, cost * 10);
+		interval = (std::min<uint64_t>)((std::max<uint64_t>)(interval, MIN_INTERVAL), MAX_INTERVAL);
+	}
+
+	snapshot->entries = walk->entries;
+	snapshot->interval = static_cast<uint32_t>(interval);
+	snapshot->due = GetTickCount64() + interval;
+	snapshot->baseline = true;
+	m_counters.reads.fetch_add(1, std::memory_order_relaxed);
+	print("path %s,scan %llu entries,%llu changes,cost %llums,next %llums\n", arg->path.c_str(),
+		walk->entries, walk->changes, cost, interval);
+}
+
+size_t FileGuard::list(Arg* arg, const std::string& relative, std::vector<std::string>& dirs, std::vector<Change>& batch)
+{
+	Snapshot* snapshot = arg->snapshot.get();
+	const std::string dir = arg->path + relative;
+	Folder folder;
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileExA((dir + "*").c_str(), FindExInfoBasic, &data,
+		FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+	if (find == INVALID_HANDLE_VALUE) {
+		//目录已不存在时视为空目录,其他错误(如网络中断)保留快照,避免误报删除
+		const DWORD ecode = GetLastError();
+		if (ecode != ERROR_FILE_NOT_FOUND && ecode != ERROR_PATH_NOT_FOUND) {
+			return 0;
+		}
+	}
+	else {
+		do {
+			if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+				continue;
+			}
+
+			const size_t length = strlen(data.cFileName);
+			if (!m_excludes.empty() && excluded(relative + data.cFileName)) {
+				continue;
+			}
+
+			Folder::Item item;
+			item.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			item.mtime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+			item.name = static_cast<uint32_t>(folder.names.size());
+			item.length = static_cast<uint16_t>(length);
+			item.attributes = static_cast<uint16_t>(data.dwFileAttributes);
+			folder.names.append(data.cFileName, length);
+			folder.items.push_back(item);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+
+		const std::string& names = folder.names;
+		std::sort(folder.items.begin(), folder.items.end(), [&names](const Folder::Item& a, const Folder::Item& b) {
+			return names.compare(a.name, a.length, names, b.name, b.length) < 0;
+		});
+		folder.names.shrink_to_fit();
+		folder.items.shrink_to_fit();
+	}
+
+	//与快照按名称归并比较
+	const uint32_t mask = arg->option.mask;
+	const size_t entries = folder.items.size();
+	std::lock_guard<std::mutex> lock(snapshot->mutex);
+	Folder& old = snapshot->folders[relative];
+	size_t i = 0, j = 0;
+	while (i < old.items.size() || j < folder.items.size()) {
+		int order = 0;
+		if (i == old.items.size()) {
+			order = 1;
+		}
+		else if (j == folder.items.size()) {
+			order = -1;
+		}
+		else {
+			order = old.names.compare(old.items[i].name, old.items[i].length,
+				folder.names, folder.items[j].name, folder.items[j].length);
+		}
+
+		if (order < 0) {
+			const Folder::Item& item = old.items[i++];
+			const std::string name = old.names.substr(item.name, item.length);
+			if (item.attributes & FILE_ATTRIBUTE_DIRECTORY) {
+				purge(arg, relative + name + "\\", batch);
+			}
+			emit(arg, Action::REMOVED, dir + name, item, batch);
+			continue;
+		}
+
+		if (order > 0) {
+			const Folder::Item& item = folder.items[j++];
+			const std::string name = folder.names.substr(item.name, item.length);
+			emit(arg, Action::ADDED, dir + name, item, batch);
+			if ((item.attributes & FILE_ATTRIBUTE_DIRECTORY) && !(item.attributes & FILE_ATTRIBUTE_REPARSE_POINT) && arg->recursive) {
+				dirs.push_back(relative + name + "\\");
+			}
+			continue;
+		}
+
+		const Folder::Item& before = old.items[i++];
+		const Folder::Item& after = folder.items[j++];
+		const std::string name = folder.names.substr(after.name, after.length);
+		const bool directory = (after.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if (directory != ((before.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)) {
+			//同名的文件与目录互相替换
+			if (!directory) {
+				purge(arg, relative + name + "\\", batch);
+			}
+			emit(arg, Action::REMOVED, dir + name, before, batch);
+			emit(arg, Action::ADDED, dir + name, after, batch);
+		}
+		else if (!directory && (((mask & LAST_WRITE_MASK) && before.mtime != after.mtime) ||
+			((mask & SIZE_MASK) && before.size != after.size) ||
+			((mask & ATTRIBUTES_MASK) && before.attributes != after.attributes))) {
+			emit(arg, Action::MODIFIED, dir + name, after, batch);
+		}
+
+		if (directory && !(after.attributes & FILE_ATTRIBUTE_REPARSE_POINT) && arg->recursive) {
+			dirs.push_back(relative + name + "\\");
+		}
+	}
+
+	if (find == INVALID_HANDLE_VALUE) {
+		snapshot->folders.erase(relative);
+	}
+	else {
+		old = std::move(folder);
+	}
+	return entries;
+}
+
+void FileGuard::purge(Arg* arg, const std::string& relative, std::vector<Change>& batch)
+{
+	Snapshot* snapshot = arg->snapshot.get();
+	auto iter = snapshot->folders.find(relative);
+	if (iter == snapshot->folders.end()) {
+		return;
+	}
+
+	const Folder folder = std::move(iter->second);
+	snapshot->folders.erase(iter);
+	for (const auto& x : folder.items) {
+		const std::string name = folder.names.substr(x.name, x.length);
+		if (x.attributes & FILE_ATTRIBUTE_DIRECTORY) {
+			purge(arg, relative + name + "\\", batch);
+		}
+		emit(arg, Action::REMOVED, arg->path + relative + name, x, batch);
+	}
+}
+
+void FileGuard::emit(Arg* arg, uint32_t action, const std::string& file, const Folder::Item& item, std::vector<Change>& batch) const
+{
+	if (!arg->snapshot->baseline) {
+		return;
+	}
+
+	//名称变化按条目类型对应订阅掩码
+	const bool directory = (item.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	if (action != Action::MODIFIED && !(arg->option.mask & (directory ? DIR_NAME_MASK : FILE_NAME_MASK))) {
+		return;
+	}
+
+	if (!accept(arg, action, file)) {
+		return;
+	}
+
+	batch.emplace_back();
+	Change& change = batch.back();
+	change.file = file;
+	change.event = Event();
+	change.event.action = action;
+	change.event.timestamp = monotonic();
+	change.event.kind = directory ? Kind::DIRECTORY_KIND : Kind::FILE_KIND;
+	change.event.attributes = item.attributes;
+	change.event.size = item.size;
+	change.event.mtime = item.mtime;
+	change.priority = arg->option.priority;
+}
+
+void FileGuard::enrich(Change* changes, size_t count)
+{
+	//同一批次中相同文件只查询一次
+	thread_local std::unordered_map<std::string, size_t> queried;
+	queried.clear();
+	for (size_t i = 0; i < count; ++i) {
+		Event& event = changes[i].event;
+		if (event.action == Action::REMOVED || event.action == Action::RENAMED_OLD_NAME) {
+			continue;
+		}
+
+		auto result = queried.insert(std::make_pair(changes[i].file, i));
+		if (!result.second) {
+			const Event& other = changes[result.first->second].event;
+			event.kind = other.kind;
+			event.attributes = other.attributes;
+			event.size = other.size;
+			event.mtime = other.mtime;
+			event.id = other.id;
+			event.volume = other.volume;
+			continue;
+		}
+
+		HANDLE handle = CreateFileA(changes[i].file.c_str(),
+			FILE_READ_ATTRIBUTES,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+			nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			continue;
+		}
+
+		BY_HANDLE_FILE_INFORMATION info = { 0 };
+		if (GetFileInformationByHandle(handle, &info)) {
+			event.kind = (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? Kind::DIRECTORY_KIND : Kind::FILE_KIND;
+			event.attributes = info.dwFileAttributes;
+			event.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+			event.mtime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+			event.id = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+			event.volume = info.dwVolumeSerialNumber;
+		}
+		CloseHandle(handle);
+	}
+}
+
+void FileGuard::notify(const Change& change)
+{
+	if (m_content) {
+		std::unique_lock<std::mutex> lock(m_fingerprintMutex);
+		if (change.event.action == Action::MODIFIED) {
+			//同一文件已在比较队列中时,比较时读取的即是最新内容,无需重复投递
+			if (m_comparing.insert(change.file).second) {
+				lock.unlock();
+				m_hashPool.post([this, change]() {
+					{
+						std::lock_guard<std::mutex> lock(m_fingerprintMutex);
+						m_comparing.erase(change.file);
+					}
+
+					const uint64_t tick = traceTick();
+					const bool changed = compare(change.file);
+					trace(TRACE_COMPARE, tick, changed);
+					if (changed) {
+						dispatch(change);
+					}
+				});
+			}
+			return;
+		}
+
+		if (change.event.action == Action::REMOVED || change.event.action == Action::RENAMED_OLD_NAME) {
+			m_fingerprints.erase(change.file);
+		}
+	}
+	dispatch(change);
+}
+
+bool FileGuard::compare(const std::string& file)
+{
+	HANDLE handle = CreateFileA(file.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		std::lock_guard<std::mutex> lock(m_fingerprintMutex);
+		m_fingerprints.erase(file);
+		return true;
+	}
+
+	Fingerprint current = { 0 };
+	BY_HANDLE_FILE_INFORMATION info = { 0 };
+	if (!GetFileInformationByHandle(handle, &info)) {
+		CloseHandle(handle);
+		return true;
+	}
+	current.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+	current.mtime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+
+	Fingerprint previous = { 0 };
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(m_fingerprintMutex);
+		auto iter = m_fingerprints.find(file);
+		if (iter != m_fingerprints.end()) {
+			previous = iter->second;
+			found = true;
+		}
+	}
+
+	//大小与修改时间均未改变,多为同一次写入的重复通知
+	if (found && previous.size == current.size && previous.mtime == current.mtime) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	if (current.size <= m_limit) {
+		static const DWORD chunk = 256 * 1024;
+		std::unique_ptr<uint8_t[]> buffer(new uint8_t[chunk]);
+		Hasher hasher;
+		DWORD bytes = 0;
+		current.hashed = true;
+		while (ReadFile(handle, buffer.get(), chunk, &bytes, nullptr) && bytes) {
+			hasher.update(buffer.get(), bytes);
+			if (bytes < chunk) {
+				break;
+			}
+		}
+		current.hash = hasher.finish();
+	}
+	CloseHandle(handle);
+
+	{
+		std::lock_guard<std::mutex> lock(m_fingerprintMutex);
+		if (m_fingerprints.size() >= 1024 * 1024) {
+			m_fingerprints.clear();
+		}
+		m_fingerprints[file] = current;
+	}
+
+	return !found || !previous.hashed || !current.hashed ||
+		previous.size != current.size || previous.hash != current.hash;
+}
+
+void FileGuard::dispatch(const Change& change)
+{
+	//启用路径驻留时,队列与回调中只保留目录ID与名称
+	thread_local Change interned;
+	const Change* target = &change;
+	if (m_intern && !change.event.directory) {
+		const size_t npos = change.file.find_last_of('\\');
+		const uint32_t id = npos == std::string::npos ? 0 : m_interner.intern(change.file.c_str(), npos + 1);
+		if (id) {
+			interned.file.assign(change.file, npos + 1, std::string::npos);
+			interned.event = change.event;
+			interned.event.directory = id;
+			interned.priority = change.priority;
+			target = &interned;
+		}
+	}
+
+	if (m_schedule) {
+		{
+			std::lock_guard<std::mutex> lock(m_scheduleMutex);
+			m_queues[target->priority].push_back(*target);
+		}
+		m_scheduleCond.notify_one();
+		return;
+	}
+	deliver(*target);
+}
+
+void FileGuard::coalesce(const Change& change, const std::string& root)
+{
+	const size_t npos = change.file.find_last_of('\\');
+	std::string dir = npos == std::string::npos ? root : change.file.substr(0, npos + 1);
+
+	std::lock_guard<std::mutex> lock(m_scheduleMutex);
+	if (m_summaries.size() >= SUMMARY_LIMIT && m_summaries.find(dir) == m_summaries.end()) {
+		dir = root;
+	}
+
+	auto result = m_summaries.insert(std::make_pair(dir, Summary()));
+	Summary& summary = result.first->second;
+	if (result.second) {
+		summary.priority = change.priority;
+	}
+
+	const uint32_t action = change.event.action;
+	if (action >= Action::ADDED && action <= Action::RENAMED_NEW_NAME) {
+		++summary.counts[action - Action::ADDED];
+	}
+}
+
+bool FileGuard::aggregate(Arg* arg, size_t count)
+{
+	Arg* root = arg->root;
+	const bool manual = root->manual.load(std::memory_order_relaxed);
+	const double rate = root->option.aggregateRate;
+	if (rate <= 0 || !count) {
+		return manual;
+	}
+
+	bool changed = false, aggregating = false;
+	{
+		//与令牌桶相同,拆分后的根与子监控、轮询的扫描线程须加锁
+		std::unique_lock<std::mutex> lock(m_loopMutex, std::defer_lock);
+		if (!arg->exclusive()) {
+			lock.lock();
+		}
+
+		const uint64_t now = monotonic();
+		const uint64_t elapsed = now - root->window;
+		root->events += count;
+		if (!root->aggregating && root->events > rate * AGGREGATE_WINDOW / 1000.0) {
+			//窗口内的事件已超出阈值时立即切换,不等窗口结束
+			changed = true;
+			root->aggregating = true;
+			root->window = now;
+			root->events = 0;
+		}
+		else if (elapsed >= AGGREGATE_WINDOW * 1000ULL) {
+			//速率降到阈值一半以下时恢复,避免在阈值附近反复切换
+			const double current = root->events * 1000000.0 / elapsed;
+			if (root->aggregating && current < rate / 2) {
+				changed = true;
+				root->aggregating = false;
+			}
+			root->window = now;
+			root->events = 0;
+		}
+		aggregating = root->aggregating;
+	}
+
+	if (changed && onStatus) {
+		onStatus(aggregating ? Status::AGGREGATED : Status::RESUMED, arg->thread, root->path.c_str());
+	}
+	return aggregating || manual;
+}
+
+void FileGuard::schedule()
+{
+	static const size_t batch = 256;
+	std::vector<Change> changes;
+	changes.reserve(batch);
+	uint64_t flushed = monotonic();
+
+	std::unique_lock<std::mutex> lock(m_scheduleMutex);
+	while (true) {
+		m_scheduleCond.wait_for(lock, std::chrono::milliseconds(SUMMARY_INTERVAL), [this]() {
+			return m_scheduleQuit || std::any_of(m_queues.begin(), m_queues.end(),
+				[](const std::pair<const int, std::deque<Change>>& x) { return !x.second.empty(); });
+		});
+
+		//到达间隔时将目录摘要按其优先级加入队列
+		const uint64_t now = monotonic();
+		if (now - flushed >= SUMMARY_INTERVAL * 1000ULL || m_scheduleQuit) {
+			for (const auto& x : m_summaries) {
+				Change change;
+				change.file = x.first;
+				change.event = Event();
+				change.event.action = Action::DIRTY;
+				change.event.timestamp = now;
+				change.event.sequence = m_sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+				memcpy(change.event.counts, x.second.counts, sizeof(change.event.counts));
+				change.priority = x.second.priority;
+				m_queues[change.priority].push_back(std::move(change));
+			}
+			m_summaries.clear();
+			flushed = now;
+		}
+
+		//每次只从最高优先级的非空队列取一批,交付期间新到的高优先级事件可在下一批抢先
+		auto iter = std::find_if(m_queues.begin(), m_queues.end(),
+			[](const std::pair<const int, std::deque<Change>>& x) { return !x.second.empty(); });
+		if (iter == m_queues.end()) {
+			if (m_scheduleQuit) {
+				break;
+			}
+			continue;
+		}
+
+		auto& queue = iter->second;
+		while (!queue.empty() && changes.size() < batch) {
+			changes.push_back(std::move(queue.front()));
+			queue.pop_front();
+		}
+
+		lock.unlock();
+		for (const auto& x : changes) {
+			deliver(x);
 		}
+		changes.clear();
+		lock.lock();
 	}
-	m_pause = true;
-	m_start = false;
 }
 
-void FileGuard::stop()
+void FileGuard::deliver(const Change& change)
 {
-	m_start = false;
-	m_pause = false;
-	for (auto& x : m_args) {
-		if (x.quit) {
-			continue;
+	const uint64_t tick = traceTick();
+	if (onChanged) {
+		//驻留的事件按需拼接完整路径
+		thread_local std::string file;
+		const char* dir = m_interner.lookup(change.event.directory);
+		if (dir) {
+			file.assign(dir);
+			file.append(change.file);
 		}
-		x.wait();
+		onChanged(change.event.action, dir ? file.c_str() : change.file.c_str());
 	}
-}
 
-bool FileGuard::restart()
-{
-	stop();
-	std::vector<Arg> args = m_args;
-	clearPaths();
-	for (const auto& x : args) {
-		if (!addPath(x.path, x.subpath)) {
-			return false;
+	if (onChangedEx) {
+		Event event = change.event;
+		event.file = change.file.c_str();
+		event.length = static_cast<uint32_t>(change.file.length());
+		onChangedEx(event);
+	}
+	trace(TRACE_CALLBACK, tick, change.event.action);
+
+	//按2的幂分桶统计读取完成到交付的延迟
+	const uint64_t latency = monotonic() - change.event.timestamp;
+	size_t bucket = 0;
+	while (bucket < 31 && (latency >> (bucket + 1))) {
+		++bucket;
+	}
+	m_counters.latencies[bucket].fetch_add(1, std::memory_order_relaxed);
+	m_counters.delivered.fetch_add(1, std::memory_order_relaxed);
+
+	if (m_poll) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pending.entries.size() >= m_capacity) {
+			++m_dropped;
+			return;
+		}
+
+		Entry entry;
+		entry.event = change.event;
+		entry.event.file = nullptr;
+		entry.event.length = static_cast<uint32_t>(change.file.length());
+		entry.offset = static_cast<uint32_t>(m_pending.data.size());
+		m_pending.data.append(change.file);
+		m_pending.entries.push_back(entry);
+		if (m_pending.entries.size() == 1) {
+			SetEvent(m_event);
 		}
 	}
-	start();
-	return true;
 }
 
-bool FileGuard::isStart() const
+FileGuard::Pool::~Pool()
 {
-	return m_start;
+	stop();
 }
 
-const char* FileGuard::getLastError() const
+void FileGuard::Pool::start(size_t count)
 {
-	return m_error.c_str();
+	if (!m_threads.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = false;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		m_threads.emplace_back([this]() {
+			while (true) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cond.wait(lock, [this]() { return m_quit || !m_tasks.empty(); });
+					if (m_tasks.empty()) {
+						break;
+					}
+					task = std::move(m_tasks.front());
+					m_tasks.pop_front();
+				}
+				task();
+			}
+		});
+	}
 }
 
-void FileGuard::addSuffix(const std::string& suffix)
+void FileGuard::Pool::stop(bool drain)
 {
-	std::string data(suffix);
-	std::transform(data.begin(), data.end(), data.begin(), std::tolower);
-	bool find = false, add = false;
-	for (const auto& x : m_suffixes) {
-		if (x == data) {
-			find = true;
-			break;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+		if (!drain) {
+			m_tasks.clear();
 		}
 	}
+	m_cond.notify_all();
 
-	if (!find) {
-		if (data.find_last_of('.') == std::string::npos) {
-			add = true;
+	for (auto& x : m_threads) {
+		if (x.joinable()) {
+			x.join();
 		}
-		m_suffixes.push_back(add ? "." + data : data);
 	}
+	m_threads.clear();
+}
 
-	for (const auto& x : m_suffixes) {
-		if (x == ALL_SUFFIXES || std::string(".") + x == ALL_SUFFIXES) {
-			m_suffixes.clear();
-			m_suffixes.push_back(ALL_SUFFIXES);
-			break;
+bool FileGuard::Pool::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_quit) {
+			return false;
 		}
+		m_tasks.push_back(std::move(task));
 	}
+	m_cond.notify_one();
+	return true;
 }
 
-void FileGuard::addSuffixes(const std::vector<std::string>& suffixes)
+void FileGuard::Queue::clear()
 {
-	m_suffixes = suffixes;
+	entries.clear();
+	data.clear();
+	index = 0;
 }
 
-void FileGuard::removeSuffix(const std::string& suffix)
+void FileGuard::setTrace(bool enable)
 {
-	std::string data(suffix);
-	std::transform(data.begin(), data.end(), data.begin(), std::tolower);
-	for (auto iter = m_suffixes.begin(); iter != m_suffixes.end(); ++iter) {
-		if (*iter == data) {
-			m_suffixes.erase(iter);
-			break;
-		}
-	}
+	g_trace.store(enable, std::memory_order_relaxed);
 }
 
-void FileGuard::removeSuffixes(const std::vector<std::string>& suffixes)
+bool FileGuard::dumpTrace(const std::string& file)
 {
-	for (auto iter = suffixes.begin(); iter != suffixes.end(); ++iter) {
-		std::string data(*iter);
-		std::transform(data.begin(), data.end(), data.begin(), std::tolower);
-		m_suffixes.erase(std::remove(m_suffixes.begin(), m_suffixes.end(), data), m_suffixes.end());
+	FILE* fp = nullptr;
+	if (fopen_s(&fp, file.c_str(), "wb") != 0 || !fp) {
+		return false;
 	}
-}
 
-void FileGuard::clearSuffixes()
-{
-	m_suffixes.clear();
-}
+	std::vector<std::shared_ptr<TraceRing>> rings;
+	{
+		std::lock_guard<std::mutex> lock(g_traceMutex);
+		rings = g_traceRings;
+	}
 
-std::vector<std::string> FileGuard::getSuffixes() const
-{
-	return m_suffixes;
+	//写入线程仍在运行时,正被覆盖的记录可能不完整,仅用于诊断
+	const unsigned long pid = GetCurrentProcessId();
+	bool first = true;
+	fputs("{\"traceEvents\":[\n", fp);
+	for (const auto& ring : rings) {
+		const uint64_t head = ring->head.load(std::memory_order_acquire);
+		const uint64_t count = (std::min<uint64_t>)(head, TraceRing::SIZE);
+		for (uint64_t i = head - count; i < head; ++i) {
+			const TraceRecord& record = ring->records[i % TraceRing::SIZE];
+			if (record.type >= sizeof(TRACE_NAMES) / sizeof(*TRACE_NAMES)) {
+				continue;
+			}
+
+			char line[256] = { 0 };
+			if (record.duration) {
+				sprintf_s(line, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%lu,\"tid\":%u,\"args\":{\"value\":%llu}}",
+					first ? "" : ",\n", TRACE_NAMES[record.type], record.timestamp, record.duration, pid, ring->thread, record.value);
+			}
+			else {
+				sprintf_s(line, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":%lu,\"tid\":%u,\"args\":{\"value\":%llu}}",
+					first ? "" : ",\n", TRACE_NAMES[record.type], record.timestamp, pid, ring->thread, record.value);
+			}
+			fputs(line, fp);
+			first = false;
+		}
+	}
+	fputs("\n]}\n", fp);
+	return fclose(fp) == 0;
 }
 
 void FileGuard::setLastError(const char* fmt, ...)
@@ -413,77 +2570,42 @@ void FileGuard::setLastError(const char* fmt, ...)
 }
 
 FileGuard::Arg::Arg()
-	: subpath(false),
-	buffer(nullptr),
+	: slot(0),
+	tokens(0),
+	refill(0),
+	window(0),
+	events(0),
+	aggregating(false),
+	manual(false),
+	block(nullptr),
 	file(INVALID_HANDLE_VALUE),
-	wevent(nullptr),
-	revent(nullptr),
-	lapped(nullptr),
-	quit(true),
+	filter(0),
 	thread(0),
 	ecode(0),
-	error{ 0 }
+	quit(true),
+	cancel(false),
+	recursive(true),
+	detached(false),
+	launched(false),
+	rescan(false),
+	pending(0),
+	root(this),
+	parent(nullptr)
 {
-	buffer = new char[size];
 	print("%s\n", __FUNCTION__);
 }
 
 FileGuard::Arg::~Arg()
 {
-	if (buffer) {
-		delete[] buffer;
-		buffer = nullptr;
-	}
-	print("%s\n", __FUNCTION__);
-}
-
-FileGuard::Arg::Arg(const Arg& o)
-	: buffer(nullptr)
-{
-	path = o.path;
-	subpath = o.subpath;
-
-	buffer = new char[size];
-	if (o.buffer) {
-		memcpy(buffer, o.buffer, o.size);
-	}
-	file = o.file;
-	wevent = o.wevent;
-	revent = o.revent;
-	lapped = o.lapped;
-	quit = o.quit;
-	thread = o.thread;
-	ecode = o.ecode;
-	memcpy(error, o.error, sizeof(error));
-	print("%s\n", __FUNCTION__);
-}
-
-FileGuard::Arg& FileGuard::Arg::operator=(const Arg& o)
-{
-	if (this == &o) {
-		return *this;
-	}
-
-	path = o.path;
-	subpath = o.subpath;
-	if (o.buffer) {
-		memcpy(buffer, o.buffer, o.size);
-	}
-	file = o.file;
-	wevent = o.wevent;
-	revent = o.revent;
-	lapped = o.lapped;
-	quit = o.quit;
-	thread = o.thread;
-	ecode = o.ecode;
-	memcpy(error, o.error, sizeof(error));
+	children.clear();
+	release();
 	print("%s\n", __FUNCTION__);
-	return *this;
 }
 
-bool FileGuard::Arg::create(const std::string& path, bool subpath)
+bool FileGuard::Arg::create(const std::string& path, const Option& option, void* port, std::string& error)
 {
 	bool result = false;
+	char temp[512] = { 0 };
 	do {
 		const char c = path.at(path.length() - 1);
 		this->path = (c != '\\' && c != '/') ? (path + "\\") : (path);
@@ -493,7 +2615,39 @@ bool FileGuard::Arg::create(const std::string& path, bool subpath)
 				x = '\\';
 		}
 
-		this->subpath = subpath;
+		this->option = option;
+		recursive = option.subpath;
+
+		//自动方式下,网络与光盘驱动器的变化通知不可靠,改为轮询
+		if (this->option.backend == AUTO_BACKEND) {
+			const UINT type = this->path.compare(0, 2, "\\\\") == 0 ? DRIVE_REMOTE : GetDriveTypeA(this->path.substr(0, 3).c_str());
+			this->option.backend = (type == DRIVE_REMOTE || type == DRIVE_CDROM) ? POLLING_BACKEND : NOTIFY_BACKEND;
+		}
+
+		//按订阅的动作收窄内核通知过滤器,未订阅的事件不会进入缓冲区
+		const uint32_t names = (1 << Action::ADDED) | (1 << Action::REMOVED) |
+			(1 << Action::RENAMED_OLD_NAME) | (1 << Action::RENAMED_NEW_NAME);
+		filter = option.mask;
+		if (!(option.actions & (1 << Action::MODIFIED))) {
+			filter &= FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+		}
+
+		if (!(option.actions & names)) {
+			filter &= ~static_cast<unsigned long>(FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME);
+		}
+
+		if (!filter) {
+			sprintf_s(temp, "%s路径的订阅掩码与动作掩码组合后为空", path.c_str());
+			error = temp;
+			break;
+		}
+
+		//轮询方式不需要目录句柄
+		if (this->option.backend == POLLING_BACKEND) {
+			snapshot.reset(new Snapshot);
+			result = true;
+			break;
+		}
 
 		file = CreateFileA(path.c_str(),
 			GENERIC_READ | GENERIC_WRITE | FILE_LIST_DIRECTORY,
@@ -503,40 +2657,18 @@ bool FileGuard::Arg::create(const std::string& path, bool subpath)
 			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
 			nullptr);
 		if (file == INVALID_HANDLE_VALUE) {
-			sprintf_s(error, "获取%s路径句柄失败,错误代码:%lu", path.c_str(), ::GetLastError());
-			break;
-		}
-
-		wevent = CreateEventA(nullptr, true, false, nullptr);
-		if (wevent == nullptr) {
-			CloseHandle(file);
-			file = INVALID_HANDLE_VALUE;
-			sprintf_s(error, "创建%s路径事件失败,错误代码:%lu", path.c_str(), ::GetLastError());
+			sprintf_s(temp, "获取%s路径句柄失败,错误代码:%lu", path.c_str(), ::GetLastError());
+			error = temp;
 			break;
 		}
 
-		revent = CreateEventA(nullptr, true, false, nullptr);
-		if (revent == nullptr) {
+		if (!port || CreateIoCompletionPort(file, port, reinterpret_cast<ULONG_PTR>(this), 0) != port) {
 			CloseHandle(file);
 			file = INVALID_HANDLE_VALUE;
-			CloseHandle(wevent);
-			wevent = nullptr;
-			sprintf_s(error, "创建%s路径折叠失败,错误代码:%lu", path.c_str(), ::GetLastError());
+			sprintf_s(temp, "关联%s路径完成端口失败,错误代码:%lu", path.c_str(), ::GetLastError());
+			error = temp;
 			break;
 		}
-
-		//buffer = new char[size];
-		//if (buffer == nullptr) {
-		//	CloseHandle(file);
-		//	file = INVALID_HANDLE_VALUE;
-		//	CloseHandle(wevent);
-		//	wevent = nullptr;
-		//	CloseHandle(revent);
-		//	revent = nullptr;
-		//	sprintf_s(error, "创建%s路径缓冲区失败,内存不足", path.c_str());
-		//	break;
-		//}
-		memset(buffer, 0, size);
 		result = true;
 	} while (false);
 	return result;
@@ -549,62 +2681,183 @@ void FileGuard::Arg::release()
 		CloseHandle(file);
 		file = INVALID_HANDLE_VALUE;
 	}
+}
 
-	if (wevent)
-	{
-		CloseHandle(wevent);
-		wevent = nullptr;
+char* FileGuard::Arg::buffer() const
+{
+	return block + header;
+}
+
+void* FileGuard::Arg::lapped() const
+{
+	return block;
+}
+
+bool FileGuard::Arg::read()
+{
+	memset(buffer(), 0, size);
+	memset(lapped(), 0, sizeof(OVERLAPPED));
+	if (!ReadDirectoryChangesW(file,
+		buffer(),
+		size,
+		recursive,
+		filter,
+		nullptr,
+		static_cast<LPOVERLAPPED>(lapped()),
+		nullptr)) {
+		ecode = GetLastError();
+		return false;
 	}
+	return true;
+}
 
-	if (revent)
-	{
-		CloseHandle(revent);
-		revent = nullptr;
+bool FileGuard::Arg::take()
+{
+	//令牌桶,按经过的时间补充令牌
+	const uint64_t now = monotonic();
+	const double burst = option.burst > 0 ? option.burst : option.rate;
+	tokens = (std::min)(burst, tokens + (now - refill) * option.rate / 1000000.0);
+	refill = now;
+	if (tokens < 1) {
+		return false;
 	}
+	tokens -= 1;
+	return true;
+}
 
-	if (lapped)
-	{
-		lapped = nullptr;
+FileGuard::Interner::Interner()
+	: m_size(1)
+{
+	static std::atomic<uint64_t> serial(0);
+	m_serial = ++serial;
+	for (auto& x : m_chunks) {
+		x.store(nullptr, std::memory_order_relaxed);
 	}
+}
 
-	if (buffer)
-	{
-		delete[] buffer;
-		buffer = nullptr;
+FileGuard::Interner::~Interner()
+{
+	for (auto& x : m_chunks) {
+		delete[] x.load(std::memory_order_relaxed);
 	}
 }
 
-void FileGuard::Arg::wait(size_t ms)
+uint32_t FileGuard::Interner::intern(const char* dir, size_t length)
 {
-	auto ok = false;
-	auto tick = GetTickCount64();
-	std::future_status status = std::future_status::timeout;
-	do 
+	//同一线程的连续事件通常位于同一目录,先与上次的结果比较,命中时无需哈希与加锁
+	thread_local uint64_t serial = 0;
+	thread_local std::string last;
+	thread_local uint32_t cached = 0;
+	if (serial == m_serial && last.size() == length && !memcmp(last.data(), dir, length)) {
+		return cached;
+	}
+
+	uint32_t id = 0;
 	{
-		if (!ok) {
-			ok = CancelIoEx(file, static_cast<LPOVERLAPPED>(lapped));
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto result = m_ids.insert(std::make_pair(std::string(dir, length), 0));
+		if (!result.second) {
+			id = result.first->second;
+		}
+		else {
+			id = m_size.load(std::memory_order_relaxed);
+			if (id >= CHUNK * CHUNKS) {
+				m_ids.erase(result.first);
+				return 0;
+			}
+
+			const char** chunk = m_chunks[id / CHUNK].load(std::memory_order_relaxed);
+			if (!chunk) {
+				chunk = new const char*[CHUNK];
+				m_chunks[id / CHUNK].store(chunk, std::memory_order_relaxed);
+			}
+			chunk[id % CHUNK] = result.first->first.c_str();
+			result.first->second = id;
+
+			//先写入内容再发布个数,读取者无需加锁
+			m_size.store(id + 1, std::memory_order_release);
 		}
+	}
 
-		status = future.wait_for(std::chrono::milliseconds(10));
+	serial = m_serial;
+	last.assign(dir, length);
+	cached = id;
+	return id;
+}
 
-		if (GetTickCount64() - tick > ms) {
-			break;
+const char* FileGuard::Interner::lookup(uint32_t id) const
+{
+	if (!id || id >= m_size.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	return m_chunks[id / CHUNK].load(std::memory_order_relaxed)[id % CHUNK];
+}
+
+bool FileGuard::Arg::exclusive() const
+{
+	//拆分后根本身也不再递归监控,其子监控在其他线程中取用同一个令牌桶
+	return root == this && recursive && !snapshot;
+}
+
+FileGuard::BlockPool::~BlockPool()
+{
+	for (auto x : m_blocks) {
+		delete[] x;
+	}
+	m_blocks.clear();
+}
+
+char* FileGuard::BlockPool::acquire()
+{
+	static_assert(sizeof(OVERLAPPED) <= Arg::header, "OVERLAPPED超出读取块头部");
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_blocks.empty()) {
+			char* block = m_blocks.back();
+			m_blocks.pop_back();
+			return block;
 		}
-	} while (status != std::future_status::ready);
+	}
+	return new (std::nothrow) char[Arg::header + Arg::size];
+}
 
-	if (!quit) {
-		quit = true;
+void FileGuard::BlockPool::release(char* block)
+{
+	if (!block) {
+		return;
 	}
 
-	if (future.valid()) {
-		future.get();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_blocks.size() < LIMIT) {
+			m_blocks.push_back(block);
+			return;
+		}
 	}
+	delete[] block;
 }
 
 #if defined(FILE_GUARD_C_API)
 
 #define get_guard(x) ((FileGuard*)(x))
 
+static void convert(const FileGuard::Event& event, uint32_t offset, file_guard_event* result)
+{
+	result->action = event.action;
+	result->offset = offset;
+	result->length = event.length;
+	result->timestamp = event.timestamp;
+	result->sequence = event.sequence;
+	result->kind = event.kind;
+	result->attributes = event.attributes;
+	result->size = event.size;
+	result->mtime = event.mtime;
+	result->id = event.id;
+	result->volume = event.volume;
+	memcpy(result->counts, event.counts, sizeof(result->counts));
+	result->directory = event.directory;
+}
+
 void* file_guard_new()
 {
 	return new FileGuard;
@@ -627,6 +2880,23 @@ bool file_guard_add_path(void* guard, const char* path, bool subpath)
 	return get_guard(guard)->addPath(path, subpath);
 }
 
+bool file_guard_add_path_ex(void* guard, const char* path, const file_guard_option* option)
+{
+	FileGuard::Option temp;
+	temp.subpath = option->subpath;
+	temp.priority = option->priority;
+	temp.rate = option->rate;
+	temp.burst = option->burst;
+	temp.mask = option->mask ? option->mask : FileGuard::DEFAULT_MASK;
+	temp.actions = option->actions ? option->actions : FileGuard::ALL_ACTIONS;
+	temp.prune = !option->no_prune;
+	temp.backend = option->backend;
+	temp.interval = option->interval;
+	temp.aggregate = option->aggregate;
+	temp.aggregateRate = option->aggregate_rate;
+	return get_guard(guard)->addPath(path, temp);
+}
+
 void file_guard_remove_path(void* guard, const char* path)
 {
 	get_guard(guard)->removePath(path);
@@ -654,6 +2924,21 @@ int file_guard_get_paths(void* guard, file_guard_path* path, int size)
 	return index;
 }
 
+bool file_guard_find_path(void* guard, const char* file, char* path, int size)
+{
+	std::string result = get_guard(guard)->findPath(file);
+	if (result.empty() || size <= 0) {
+		return false;
+	}
+	strncpy_s(path, size, result.c_str(), _TRUNCATE);
+	return true;
+}
+
+bool file_guard_set_aggregate(void* guard, const char* path, bool aggregate)
+{
+	return get_guard(guard)->setAggregate(path, aggregate);
+}
+
 void file_guard_set_on_changed_callback(void* guard, void(*callback)(uint32_t action, const char* file, void* user), void* user)
 {
 	get_guard(guard)->onChanged = [user, callback](uint32_t action, const char* file) {
@@ -661,6 +2946,15 @@ void file_guard_set_on_changed_callback(void* guard, void(*callback)(uint32_t ac
 	};
 }
 
+void file_guard_set_on_changed_ex_callback(void* guard, void(*callback)(const file_guard_event* event, const char* file, void* user), void* user)
+{
+	get_guard(guard)->onChangedEx = [user, callback](const FileGuard::Event& event) {
+		file_guard_event result;
+		convert(event, 0, &result);
+		callback(&result, event.file, user);
+	};
+}
+
 void file_guard_set_on_status_callback(void* guard, void(*callback)(int status, uint32_t thread, const char* path, void* user), void* user)
 {
 	get_guard(guard)->onStatus = [user, callback](int status, uint32_t thread, const char* path) {
@@ -720,6 +3014,50 @@ bool file_guard_is_start(void* guard)
 	return get_guard(guard)->isStart();
 }
 
+uint64_t file_guard_get_start_latency(void* guard)
+{
+	return get_guard(guard)->getStartLatency();
+}
+
+uint64_t file_guard_get_stop_latency(void* guard)
+{
+	return get_guard(guard)->getStopLatency();
+}
+
+void file_guard_get_statistics(void* guard, file_guard_statistics* statistics)
+{
+	static_assert(sizeof(file_guard_statistics) == sizeof(FileGuard::Statistics), "statistics layout mismatch");
+	const FileGuard::Statistics temp = get_guard(guard)->getStatistics();
+	memcpy(statistics, &temp, sizeof(temp));
+}
+
+void file_guard_reset_statistics(void* guard)
+{
+	get_guard(guard)->resetStatistics();
+}
+
+uint64_t file_guard_get_percentile(const file_guard_statistics* statistics, double percentile)
+{
+	FileGuard::Statistics temp;
+	memcpy(&temp, statistics, sizeof(temp));
+	return FileGuard::getPercentile(temp, percentile);
+}
+
+uint64_t file_guard_get_sequence(void* guard)
+{
+	return get_guard(guard)->getSequence();
+}
+
+void file_guard_set_trace(bool enable)
+{
+	FileGuard::setTrace(enable);
+}
+
+bool file_guard_dump_trace(const char* file)
+{
+	return FileGuard::dumpTrace(file);
+}
+
 void file_guard_get_error(void* guard, char* error, int size)
 {
 	strncpy_s(error, size, get_guard(guard)->getLastError(), _TRUNCATE);
@@ -756,5 +3094,73 @@ int file_guard_get_suffixes(void* guard, char(*suffixes)[256], int size)
 	return (int)i;
 }
 
+void file_guard_add_exclude(void* guard, const char* rule)
+{
+	get_guard(guard)->addExclude(rule);
+}
+
+void file_guard_remove_exclude(void* guard, const char* rule)
+{
+	get_guard(guard)->removeExclude(rule);
+}
+
+void file_guard_clear_excludes(void* guard)
+{
+	get_guard(guard)->clearExcludes();
+}
+
+void file_guard_set_poll_mode(void* guard, bool enable, int capacity)
+{
+	get_guard(guard)->setPollMode(enable, capacity > 0 ? static_cast<size_t>(capacity) : 1024 * 1024);
+}
+
+int file_guard_poll(void* guard, file_guard_event* events, int max, char* buffer, int size, int timeout_ms)
+{
+	if (max <= 0 || size <= 0) {
+		return 0;
+	}
+
+	thread_local std::vector<FileGuard::Event> temp;
+	if (temp.size() < static_cast<size_t>(max)) {
+		temp.resize(max);
+	}
+
+	size_t count = get_guard(guard)->poll(temp.data(), max, buffer, size, timeout_ms < 0 ? INFINITE : timeout_ms);
+	for (size_t i = 0; i < count; ++i) {
+		convert(temp[i], static_cast<uint32_t>(temp[i].file - buffer), &events[i]);
+	}
+	return static_cast<int>(count);
+}
+
+void* file_guard_get_poll_handle(void* guard)
+{
+	return get_guard(guard)->getPollHandle();
+}
+
+uint64_t file_guard_get_poll_dropped(void* guard)
+{
+	return get_guard(guard)->getPollDropped();
+}
+
+void file_guard_set_content_filter(void* guard, bool enable, uint64_t limit, int threads)
+{
+	get_guard(guard)->setContentFilter(enable, limit, threads > 0 ? static_cast<size_t>(threads) : 2);
+}
+
+void file_guard_set_metadata(void* guard, bool enable)
+{
+	get_guard(guard)->setMetadata(enable);
+}
+
+void file_guard_set_intern(void* guard, bool enable)
+{
+	get_guard(guard)->setIntern(enable);
+}
+
+const char* file_guard_get_directory(void* guard, uint32_t id)
+{
+	return get_guard(guard)->getDirectory(id);
+}
+
 #endif // !FILE_GUARD_BUILD_DLL
 
@@ -2,11 +2,18 @@
 #define __FILE_GUARD_H__
 
 #include <functional>
+#include <atomic>
 #include <algorithm>
-#include <future>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <string>
 #include <vector>
+#include <deque>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 class FileGuard
 {
@@ -28,6 +35,9 @@ public:
 
 		// 重命名新名称动作
 		RENAMED_NEW_NAME,
+
+		// 目录摘要动作(超出速率限制的事件按目录合并,counts为各动作次数)
+		DIRTY,
 	};
 
 	// 监控状态
@@ -40,6 +50,180 @@ public:
 
 		// 已停止
 		STOPPED,
+
+		// 已切换为目录摘要(事件速率超出阈值)
+		AGGREGATED,
+
+		// 已恢复逐文件交付
+		RESUMED,
+	};
+
+	// 文件类型
+	enum Kind
+	{
+		// 未知(未启用元数据,或文件已不存在)
+		UNKNOWN_KIND,
+
+		// 文件
+		FILE_KIND,
+
+		// 目录
+		DIRECTORY_KIND,
+	};
+
+	// 事件
+	struct Event
+	{
+		// 动作
+		uint32_t action;
+
+		// 文件(以'\0'结尾,轮询时指向调用者提供的缓冲区)
+		const char* file;
+
+		// 文件长度(不含'\0')
+		uint32_t length;
+
+		// 时间戳(微秒,单调时钟,取自内核读取完成时,同一次读取的事件相同;轮询时为列举时)
+		uint64_t timestamp;
+
+		// 序号(同一对象内从1开始按观察顺序递增,合并为目录摘要或被内容比较过滤的事件会留下空缺)
+		uint64_t sequence;
+
+		// 文件类型(此字段及以下字段需启用元数据)
+		uint32_t kind;
+
+		// 文件属性
+		uint32_t attributes;
+
+		// 文件大小
+		uint64_t size;
+
+		// 修改时间(FILETIME格式)
+		uint64_t mtime;
+
+		// 文件ID
+		uint64_t id;
+
+		// 卷序列号
+		uint32_t volume;
+
+		// 各动作次数(仅目录摘要动作,下标为动作减1)
+		uint32_t counts[5];
+
+		// 目录ID(仅启用路径驻留时非0,此时文件只含名称,目录通过getDirectory获取)
+		uint32_t directory;
+	};
+
+	// 订阅掩码(取值与ReadDirectoryChangesW的通知过滤器相同)
+	enum Mask
+	{
+		// 文件名变化(文件的添加、删除、重命名)
+		FILE_NAME_MASK = 0x00000001,
+
+		// 目录名变化(目录的添加、删除、重命名)
+		DIR_NAME_MASK = 0x00000002,
+
+		// 属性变化
+		ATTRIBUTES_MASK = 0x00000004,
+
+		// 大小变化
+		SIZE_MASK = 0x00000008,
+
+		// 最后写入时间变化
+		LAST_WRITE_MASK = 0x00000010,
+
+		// 最后访问时间变化
+		LAST_ACCESS_MASK = 0x00000020,
+
+		// 创建时间变化
+		CREATION_MASK = 0x00000040,
+
+		// 安全描述符变化
+		SECURITY_MASK = 0x00000100,
+
+		// 默认掩码
+		DEFAULT_MASK = FILE_NAME_MASK | DIR_NAME_MASK | LAST_WRITE_MASK,
+	};
+
+	// 监控方式
+	enum Backend
+	{
+		// 自动(网络与光盘驱动器使用轮询,其余使用变化通知)
+		AUTO_BACKEND,
+
+		// 变化通知(ReadDirectoryChangesW)
+		NOTIFY_BACKEND,
+
+		// 轮询(定期扫描并与快照比较,适用于不支持变化通知的文件系统)
+		POLLING_BACKEND,
+	};
+
+	// 所有动作(动作掩码中第action位代表订阅该动作)
+	static const uint32_t ALL_ACTIONS = 0xFFFFFFFF;
+
+	// 路径选项
+	struct Option
+	{
+		// 是否监控子路径
+		bool subpath = true;
+
+		// 优先级(数值越大越先投递)
+		int priority = 0;
+
+		// 速率限制(每秒事件个数,0代表不限制)
+		double rate = 0;
+
+		// 突发容量(事件个数,0代表与速率相同)
+		double burst = 0;
+
+		// 订阅掩码(Mask的组合)
+		uint32_t mask = DEFAULT_MASK;
+
+		// 动作掩码(1 << Action的组合),未订阅的动作会尽量在内核中过滤
+		uint32_t actions = ALL_ACTIONS;
+
+		// 存在排除规则时是否拆分监控,使被排除的子树不进入内核监控(添加路径时会遍历一次目录树)
+		bool prune = true;
+
+		// 监控方式(Backend)
+		int backend = AUTO_BACKEND;
+
+		// 轮询间隔(毫秒,0代表按扫描耗时与变化频率在1秒到60秒之间自适应)
+		uint32_t interval = 0;
+
+		// 是否只交付目录摘要(不逐个交付文件事件)
+		bool aggregate = false;
+
+		// 自动切换为目录摘要的事件速率(每秒事件个数,0代表不自动切换),速率降到一半以下时恢复逐文件交付
+		double aggregateRate = 0;
+	};
+
+	// 统计(用于确认事件是否完整交付)
+	struct Statistics
+	{
+		// 完成的读取次数(轮询方式为完成的扫描次数)
+		uint64_t reads;
+
+		// 读取的字节数
+		uint64_t bytes;
+
+		// 缓冲区溢出次数(内核丢弃了该次读取期间的所有变化)
+		uint64_t overflows;
+
+		// 通过过滤的事件个数
+		uint64_t decoded;
+
+		// 合并为目录摘要的事件个数
+		uint64_t coalesced;
+
+		// 交付的事件个数(含目录摘要)
+		uint64_t delivered;
+
+		// 轮询队列已满丢弃的事件个数
+		uint64_t dropped;
+
+		// 读取完成到交付的延迟分布(下标i为[2^i, 2^(i+1))微秒内交付的事件个数)
+		uint64_t latencies[32];
 	};
 
 	/*
@@ -69,6 +253,16 @@ public:
 	*/
 	bool addPath(const std::string& path, bool subpath = true);
 
+	/*
+	* @brief 添加路径
+	* @param[in] path 路径(*代表监控所有磁盘)(&代表监控除系统盘以外的磁盘)
+	* @param[in] option 路径选项
+	* @retval true 成功
+	* @retval false 失败
+	* @note 任一路径设置了优先级或速率限制时,回调改由独立的投递线程按优先级调用
+	*/
+	bool addPath(const std::string& path, const Option& option);
+
 	/*
 	* @brief 删除路径
 	* @param[in] path 路径
@@ -88,6 +282,29 @@ public:
 	*/
 	std::map<std::string, bool> getPaths() const;
 
+	/*
+	* @brief 查找文件所属的监控路径
+	* @param[in] file 文件
+	* @return 覆盖该文件且层级最深的监控路径,不存在时为空
+	*/
+	std::string findPath(const std::string& file) const;
+
+	/*
+	* @brief 获取嵌套路径
+	* @param[in] path 路径
+	* @return 位于该路径之下(含自身)的监控路径
+	*/
+	std::vector<std::string> getNestedPaths(const std::string& path) const;
+
+	/*
+	* @brief 设置目录摘要(可在监控期间调用)
+	* @param[in] path 路径(须为已添加的路径)
+	* @param[in] aggregate 是否只交付目录摘要,摘要每100毫秒按目录交付一次,counts为各动作次数
+	* @retval true 成功
+	* @retval false 路径不存在
+	*/
+	bool setAggregate(const std::string& path, bool aggregate);
+
 	/*
 	* @brief 启动
 	* @return void
@@ -113,6 +330,44 @@ public:
 	*/
 	bool restart();
 
+	/*
+	* @brief 获取启动耗时
+	* @return 最近一次start调用到所有路径均已投递首次读取的耗时(微秒)
+	*/
+	uint64_t getStartLatency() const;
+
+	/*
+	* @brief 获取停止耗时
+	* @return 最近一次stop调用的耗时(微秒)
+	*/
+	uint64_t getStopLatency() const;
+
+	/*
+	* @brief 获取统计
+	* @return 自构造或上次重置以来的统计
+	*/
+	Statistics getStatistics() const;
+
+	/*
+	* @brief 重置统计
+	* @return void
+	*/
+	void resetStatistics();
+
+	/*
+	* @brief 获取延迟百分位
+	* @param[in] statistics 统计
+	* @param[in] percentile 百分位(0~100)
+	* @return 延迟上界(微秒,按2的幂取整),没有交付的事件时为0
+	*/
+	static uint64_t getPercentile(const Statistics& statistics, double percentile);
+
+	/*
+	* @brief 获取序号
+	* @return 最近分配的事件序号(可与Event::sequence比较,估算尚未交付的事件个数)
+	*/
+	uint64_t getSequence() const;
+
 	/*
 	* @brief 是否启动
 	* @retval true 已启动
@@ -166,10 +421,126 @@ public:
 	*/
 	std::vector<std::string> getSuffixes() const;
 
+	/*
+	* @brief 添加排除规则
+	* @param[in] rule 目录名(如node_modules,匹配任意层级)或相对于监控路径的目录(如.git\\objects)
+	* @return void
+	* @note 须在添加路径前设置,添加路径时据此拆分监控;之后修改的规则仅在用户态丢弃事件,restart后才重新拆分
+	*/
+	void addExclude(const std::string& rule);
+
+	/*
+	* @brief 删除排除规则
+	* @param[in] rule 规则
+	* @return void
+	*/
+	void removeExclude(const std::string& rule);
+
+	/*
+	* @brief 清空排除规则
+	* @return void
+	*/
+	void clearExcludes();
+
+	/*
+	* @brief 获取排除规则
+	* @return 规范化后的规则
+	*/
+	std::vector<std::string> getExcludes() const;
+
+	/*
+	* @brief 设置轮询模式
+	* @param[in] enable 是否启用(启用后事件同时写入内部队列,由poll批量取出)
+	* @param[in] capacity 队列容量(事件个数),队列满时丢弃新事件
+	* @return void
+	*/
+	void setPollMode(bool enable, size_t capacity = 1024 * 1024);
+
+	/*
+	* @brief 轮询事件(仅允许单个线程调用)
+	* @param[out] events 事件数组
+	* @param[in] count 事件数组大小
+	* @param[out] buffer 路径缓冲区,事件中的文件指向此缓冲区
+	* @param[in] size 路径缓冲区大小(至少应能容纳一个路径)
+	* @param[in] timeout 队列为空时的等待时间(毫秒)
+	* @return 取出的事件个数
+	*/
+	size_t poll(Event* events, size_t count, char* buffer, size_t size, uint32_t timeout = 0);
+
+	/*
+	* @brief 获取轮询句柄
+	* @return 可等待的事件句柄,队列中存在事件时有信号,未启用轮询模式时为nullptr
+	*/
+	void* getPollHandle() const;
+
+	/*
+	* @brief 获取轮询丢弃的事件个数
+	* @return 因队列已满而丢弃的事件个数
+	*/
+	uint64_t getPollDropped() const;
+
+	/*
+	* @brief 设置内容过滤
+	* @param[in] enable 是否启用(启用后,内容未改变的修改动作将被丢弃)
+	* @param[in] limit 计算哈希的文件大小上限(字节),超过上限时仅比较大小与修改时间
+	* @param[in] threads 后台哈希线程个数
+	* @return void
+	* @note 修改动作在后台线程中比较指纹后投递,可能晚于同批次的其他动作
+	*/
+	void setContentFilter(bool enable, uint64_t limit = 64 * 1024 * 1024, size_t threads = 2);
+
+	/*
+	* @brief 设置元数据
+	* @param[in] enable 是否启用(启用后,每批事件解码后统一查询一次文件大小、修改时间、类型及文件ID)
+	* @return void
+	* @note 删除与重命名旧名称动作的文件已不存在,不填充元数据
+	*/
+	void setMetadata(bool enable);
+
+	/*
+	* @brief 设置路径驻留
+	* @param[in] enable 是否启用(启用后事件只携带目录ID与名称,队列与回调中不再重复保存目录)
+	* @return void
+	* @note 目录ID在对象的整个生命周期内保持不变,onChanged仍收到完整路径
+	*/
+	void setIntern(bool enable);
+
+	/*
+	* @brief 获取目录
+	* @param[in] id 目录ID(Event::directory)
+	* @return 以'\\'结尾的目录,ID无效时为nullptr(在对象的整个生命周期内有效,可跨线程读取)
+	*/
+	const char* getDirectory(uint32_t id) const;
+
+	/*
+	* @brief 获取完整路径
+	* @param[in] event 事件(驻留或未驻留)
+	* @return 完整路径
+	*/
+	std::string getPath(const Event& event) const;
+
+	/*
+	* @brief 设置跟踪
+	* @param[in] enable 是否启用(启用后各线程将读取、解码、回调、取消等记录写入各自的环形缓冲区)
+	* @return void
+	*/
+	static void setTrace(bool enable);
+
+	/*
+	* @brief 导出跟踪
+	* @param[in] file 文件(Chrome/Perfetto跟踪JSON格式,每个线程保留最近4096条记录)
+	* @retval true 成功
+	* @retval false 失败
+	*/
+	static bool dumpTrace(const std::string& file);
+
 	//改变回调
 	std::function<void(uint32_t action, const char* file)> onChanged = nullptr;
 
-	//错误回调
+	//扩展改变回调
+	std::function<void(const Event& event)> onChangedEx = nullptr;
+
+	//错误回调(缓冲区溢出时error为ERROR_NOTIFY_ENUM_DIR,监控继续,path之下的变化需重新扫描)
 	std::function<void(uint32_t error, const char* path)> onError = nullptr;
 
 	//状态回调
@@ -192,49 +563,533 @@ protected:
 	*/
 	void setLastError(const char* fmt, ...);
 
+	//改变记录
+	struct Change
+	{
+		std::string file;
+		Event event;
+		int priority;
+	};
+
+	//目录摘要
+	struct Summary
+	{
+		int priority;
+		uint32_t counts[5];
+	};
+
+	/*
+	* @brief 通知文件改变
+	* @param[in] change 改变记录
+	* @return void
+	*/
+	void notify(const Change& change);
+
+	/*
+	* @brief 投递文件改变
+	* @param[in] change 改变记录
+	* @return void
+	*/
+	void dispatch(const Change& change);
+
+	/*
+	* @brief 填充元数据
+	* @param[in,out] changes 改变记录
+	* @param[in] count 记录个数
+	* @return void
+	*/
+	void enrich(Change* changes, size_t count);
+
+	/*
+	* @brief 交付文件改变(调用回调并写入轮询队列)
+	* @param[in] change 改变记录
+	* @return void
+	*/
+	void deliver(const Change& change);
+
+	/*
+	* @brief 合并为目录摘要
+	* @param[in] change 改变记录
+	* @param[in] root 监控路径(摘要表已满时合并到此路径)
+	* @return void
+	*/
+	void coalesce(const Change& change, const std::string& root);
+
+	/*
+	* @brief 投递线程(按优先级交付,并定期交付目录摘要)
+	* @return void
+	*/
+	void schedule();
+
+	/*
+	* @brief 比较文件指纹
+	* @param[in] file 文件
+	* @retval true 内容已改变(或无法判断)
+	* @retval false 内容未改变
+	*/
+	bool compare(const std::string& file);
+
 private:
 	
-	//参数
+	//轮询快照中的目录(条目按名称排序,名称集中存放)
+	struct Folder
+	{
+		struct Item
+		{
+			uint64_t size;
+			uint64_t mtime;
+			uint32_t name; //名称在names中的偏移
+			uint16_t length;
+			uint16_t attributes; //低16位属性
+		};
+
+		std::string names;
+		std::vector<Item> items;
+	};
+
+	//轮询快照
+	struct Snapshot
+	{
+		//键为相对于监控路径的目录(以'\\'结尾,根目录为空)
+		std::unordered_map<std::string, Folder> folders;
+		std::mutex mutex;
+		uint64_t due = 0; //下次扫描的时间(毫秒)
+		uint32_t interval = 0; //当前扫描间隔(毫秒)
+		uint64_t entries = 0; //上次扫描的条目个数
+		bool baseline = false; //是否已建立基准
+	};
+
+	//参数(监控记录)
+	//地址在监控期间作为完成键,因此不可复制,只能通过unique_ptr转移所有权.
+	//读取块(OVERLAPPED与64KB缓冲区)仅在监控期间从池中借用,
+	//未启动的路径约占用0.5KB(不含路径字符串),监控中另占用一个读取块
 	struct Arg
 	{
 		std::string path;
-		std::future<void> future;
-		bool subpath;
-		char* buffer;
-		static const size_t size = 64 * 1024; //64kb
+		std::string key;
+		Option option;
+		size_t slot;
+		double tokens;
+		uint64_t refill;
+		uint64_t window; //速率统计窗口的开始时间(微秒)
+		uint64_t events; //窗口内的事件个数
+		bool aggregating; //是否已自动切换为目录摘要
+		std::atomic<bool> manual; //是否手动切换为目录摘要(setAggregate可在监控期间修改)
+		char* block;
 		void* file;
-		void* wevent;
-		void* revent;
-		void* lapped;
-		bool quit;
+		unsigned long filter;
 		unsigned long thread;
 		unsigned long ecode;
-		char error[256];
+		bool quit;
+		bool cancel;
+		bool recursive; //是否由内核递归监控子目录(拆分后为false)
+		bool detached; //目录已删除或移出,结束后回收
+		bool launched; //监控期间新建或移入的子目录,首次读取不计入启动耗时
+		bool rescan; //是否已有待执行的子目录重新扫描
+		uint32_t pending; //待执行的子目录重新扫描个数(非0时不回收)
+		Arg* root; //用户添加的监控路径(拆分出的子监控指向其根)
+		Arg* parent;
+		std::vector<std::unique_ptr<Arg>> children; //拆分出的子监控,不进入索引
+		std::unordered_set<std::string> subdirs; //直接子目录(规范化,仅拆分后强制订阅目录名时维护,监控期间须持有m_loopMutex)
+		std::vector<std::pair<uint32_t, std::string>> skips; //本次读取中强制订阅产生的目录名记录,解码时丢弃
+		std::unique_ptr<Snapshot> snapshot; //轮询快照(仅轮询方式)
+		static const size_t size = 64 * 1024; //64kb
+		static const size_t header = 64; //OVERLAPPED
 
 		Arg();
 
 		~Arg();
 
-		Arg(const Arg& o);
+		Arg(const Arg&) = delete;
 
-		Arg& operator=(const Arg& o);
+		Arg& operator=(const Arg&) = delete;
 
-		//创建
-		bool create(const std::string& path, bool subpath);
+		//创建(并关联到完成端口)
+		bool create(const std::string& path, const Option& option, void* port, std::string& error);
 
 		//释放
 		void release();
 
-		//等待
-		void wait(size_t ms = 5000);
+		//读取缓冲区
+		char* buffer() const;
+
+		//重叠结构
+		void* lapped() const;
+
+		//投递读取
+		bool read();
+
+		//获取令牌
+		bool take();
+
+		//根上的令牌桶等状态是否只由本线程访问(未拆分的递归监控,且不是轮询)
+		bool exclusive() const;
+	};
+
+	//读取块池
+	class BlockPool
+	{
+	public:
+		~BlockPool();
+
+		//借用读取块,失败返回nullptr
+		char* acquire();
+
+		//归还读取块
+		void release(char* block);
+
+	private:
+		//最多缓存的空闲块个数
+		static const size_t LIMIT = 256;
+
+		std::mutex m_mutex;
+		std::vector<char*> m_blocks;
+	};
+
+	//目录驻留表(只追加,ID从1开始,查询无锁)
+	class Interner
+	{
+	public:
+		Interner();
+
+		~Interner();
+
+		//驻留目录,表已满时返回0
+		uint32_t intern(const char* dir, size_t length);
+
+		//查询目录,ID无效时返回nullptr
+		const char* lookup(uint32_t id) const;
+
+	private:
+		//每块的目录个数
+		static const size_t CHUNK = 4096;
+
+		//最多的块数(共1600万个目录)
+		static const size_t CHUNKS = 4096;
+
+		std::mutex m_mutex;
+		std::unordered_map<std::string, uint32_t> m_ids; //节点不会移动,键即为驻留的字符串
+		std::atomic<const char**> m_chunks[CHUNKS];
+		std::atomic<uint32_t> m_size;
+		uint64_t m_serial;
+	};
+
+	//路径前缀树节点
+	struct Node
+	{
+		std::unordered_map<std::string, std::unique_ptr<Node>> children;
+		Arg* arg = nullptr;
+	};
+
+	/*
+	* @brief 登记参数到索引
+	* @param[in] arg 参数
+	* @return void
+	*/
+	void link(std::unique_ptr<Arg> arg);
+
+	/*
+	* @brief 从索引中移除并销毁参数
+	* @param[in] arg 参数
+	* @return void
+	*/
+	void unlink(Arg* arg);
+
+	/*
+	* @brief 事件循环(完成端口工作线程)
+	* @return void
+	*/
+	void loop();
+
+	/*
+	* @brief 继续读取,已请求停止或读取失败时结束监控
+	* @param[in] arg 参数
+	* @return void
+	*/
+	void resume(Arg* arg);
+
+	/*
+	* @brief 结束监控
+	* @param[in] arg 参数
+	* @param[in] ecode 错误代码(0代表正常结束)
+	* @return void
+	*/
+	void finish(Arg* arg, unsigned long ecode);
+
+	/*
+	* @brief 取消监控并等待结束
+	* @param[in] arg 参数
+	* @return void
+	*/
+	void cancel(Arg* arg);
+
+	/*
+	* @brief 收集监控及其拆分出的所有子监控(须持有m_loopMutex)
+	* @param[in] arg 参数
+	* @param[out] args 结果
+	* @return void
+	*/
+	static void collect(Arg* arg, std::vector<Arg*>& args);
+
+	/*
+	* @brief 监控及其所有子监控是否均已结束(须持有m_loopMutex)
+	* @param[in] arg 参数
+	* @return bool
+	*/
+	static bool idle(const Arg* arg);
+
+	/*
+	* @brief 是否被排除
+	* @param[in] relative 相对于监控路径的路径
+	* @return bool
+	*/
+	bool excluded(const std::string& relative) const;
+
+	/*
+	* @brief 遍历目录(跳过被排除的子树),记录子树中含有被排除目录的目录
+	* @param[in] dir 目录(以'\\'结尾)
+	* @param[in] offset 监控路径的长度
+	* @param[out] splits 需要拆分的目录(规范化路径)
+	* @return 子树中是否含有被排除的目录
+	*/
+	bool survey(const std::string& dir, size_t offset, std::unordered_set<std::string>& splits) const;
+
+	/*
+	* @brief 拆分监控,改为只监控自身,并为未被排除的子目录创建子监控
+	* @param[in] arg 参数
+	* @param[in] splits 需要拆分的目录
+	* @return void
+	*/
+	void expand(Arg* arg, const std::unordered_set<std::string>& splits);
+
+	/*
+	* @brief 为子目录创建子监控
+	* @param[in] arg 父监控
+	* @param[in] name 子目录名称
+	* @param[in] splits 需要拆分的目录
+	* @return 子监控,失败时为nullptr
+	*/
+	Arg* attach(Arg* arg, const std::string& name, const std::unordered_set<std::string>& splits);
+
+	/*
+	* @brief 按拆分监控收到的目录增删调整子监控
+	* @param[in] arg 拆分后的监控
+	* @return void
+	*/
+	void adjust(Arg* arg);
+
+	/*
+	* @brief 请求在扫描线程中重新扫描拆分监控的直接子目录(已有待执行的扫描时忽略)
+	* @param[in] arg 拆分后的监控
+	* @return void
+	*/
+	void rescan(Arg* arg);
+
+	/*
+	* @brief 重新扫描拆分监控的直接子目录,为新增的子目录创建并启动子监控,分离已不存在的子目录(扫描线程)
+	* @param[in] arg 拆分后的监控
+	* @return void
+	*/
+	void resync(Arg* arg);
+
+	/*
+	* @brief 启动新建的子监控(父监控运行时)
+	* @param[in] arg 子监控
+	* @return void
+	*/
+	void launch(Arg* arg);
+
+	/*
+	* @brief 分离子监控,取消后回收(须持有m_loopMutex)
+	* @param[in] arg 子监控
+	* @return void
+	*/
+	void detach(Arg* arg);
+
+	/*
+	* @brief 回收已结束的分离子监控,并逐级向上回收(须持有m_loopMutex)
+	* @param[in] arg 子监控
+	* @return void
+	*/
+	static void reap(Arg* arg);
+
+	/*
+	* @brief 是否接受事件(动作掩码、后缀与排除规则)
+	* @param[in] arg 参数
+	* @param[in] action 动作
+	* @param[in] file 文件
+	* @return bool
+	*/
+	bool accept(const Arg* arg, uint32_t action, const std::string& file) const;
+
+	/*
+	* @brief 提交一批改变(填充元数据、速率限制或合并为目录摘要后通知)
+	* @param[in] arg 参数
+	* @param[in] changes 改变
+	* @param[in] count 个数
+	* @return void
+	*/
+	void submit(Arg* arg, Change* changes, size_t count);
+
+	/*
+	* @brief 统计事件速率并判断是否合并为目录摘要
+	* @param[in] arg 参数
+	* @param[in] count 本批事件个数
+	* @retval true 本批合并为目录摘要
+	* @retval false 本批逐文件交付
+	*/
+	bool aggregate(Arg* arg, size_t count);
+
+	/*
+	* @brief 轮询线程,按各路径的间隔调度扫描
+	* @return void
+	*/
+	void sweep();
+
+	/*
+	* @brief 扫描一次(并行遍历目录树并与快照比较)
+	* @param[in] arg 参数
+	* @return void
+	*/
+	void scan(Arg* arg);
+
+	/*
+	* @brief 列举一个目录并与快照比较
+	* @param[in] arg 参数
+	* @param[in] relative 相对于监控路径的目录
+	* @param[out] dirs 需要继续遍历的子目录
+	* @param[out] batch 产生的改变
+	* @return 条目个数
+	*/
+	size_t list(Arg* arg, const std::string& relative, std::vector<std::string>& dirs, std::vector<Change>& batch);
+
+	/*
+	* @brief 从快照中删除目录子树,并为其中的条目产生删除动作(须持有快照锁)
+	* @param[in] arg 参数
+	* @param[in] relative 相对于监控路径的目录
+	* @param[out] batch 产生的改变
+	* @return void
+	*/
+	void purge(Arg* arg, const std::string& relative, std::vector<Change>& batch);
+
+	/*
+	* @brief 为快照中的条目产生改变(建立基准之前不产生)
+	* @param[in] arg 参数
+	* @param[in] action 动作
+	* @param[in] file 文件
+	* @param[in] item 条目
+	* @param[out] batch 产生的改变
+	* @return void
+	*/
+	void emit(Arg* arg, uint32_t action, const std::string& file, const Folder::Item& item, std::vector<Change>& batch) const;
+
+	/*
+	* @brief 解码通知缓冲区
+	* @param[in] arg 参数
+	* @param[in] timestamp 读取完成时间戳(微秒)
+	* @return void
+	*/
+	void decode(Arg* arg, uint64_t timestamp);
+
+	//读取块池(须在参数之前构造,之后析构)
+	BlockPool m_blocks;
+
+	//参数(地址在监控期间作为完成键,不可移动)
+	std::vector<std::unique_ptr<Arg>> m_args;
+
+	//路径索引(规范化路径->参数)
+	std::unordered_map<std::string, Arg*> m_index;
+
+	//路径前缀树(按规范化路径的各级目录)
+	Node m_tree;
+
+	//路径列表(路径->是否监控子路径)
+	std::map<std::string, bool> m_paths;
+
+	//完成端口
+	void* m_port = nullptr;
+
+	//事件循环线程
+	std::vector<std::thread> m_loops;
+
+	//循环锁
+	std::mutex m_loopMutex;
+
+	//循环条件
+	std::condition_variable m_loopCond;
+
+	//正在监控的个数
+	size_t m_running = 0;
+
+	//尚未投递首次读取的个数
+	size_t m_starting = 0;
+
+	//停止等待超时(毫秒),超时后强制关闭仍未结束的路径句柄
+	static const uint32_t STOP_TIMEOUT = 5000;
+
+	//启动时间(微秒)
+	uint64_t m_startTick = 0;
+
+	//启动耗时(微秒)
+	uint64_t m_startLatency = 0;
+
+	//停止耗时(微秒)
+	uint64_t m_stopLatency = 0;
+
+	//统计计数(各线程无锁累加)
+	struct Counters
+	{
+		std::atomic<uint64_t> reads;
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> overflows;
+		std::atomic<uint64_t> decoded;
+		std::atomic<uint64_t> coalesced;
+		std::atomic<uint64_t> delivered;
+		std::atomic<uint64_t> latencies[32];
 	};
 
-	//参数
-	std::vector<Arg> m_args;
+	//统计
+	Counters m_counters;
+
+	//事件序号
+	std::atomic<uint64_t> m_sequence{ 0 };
+
+	//摘要间隔(毫秒)
+	static const uint32_t SUMMARY_INTERVAL = 100;
+
+	//摘要表上限(目录个数)
+	static const size_t SUMMARY_LIMIT = 64 * 1024;
+
+	//目录摘要的速率统计窗口(毫秒)
+	static const uint32_t AGGREGATE_WINDOW = 1000;
+
+	//是否按优先级投递(setAggregate可在监控期间开启,事件循环线程读取)
+	std::atomic<bool> m_schedule{ false };
+
+	//投递线程
+	std::thread m_scheduler;
+
+	//投递锁
+	std::mutex m_scheduleMutex;
+
+	//投递条件
+	std::condition_variable m_scheduleCond;
+
+	//投递队列(按优先级从高到低)
+	std::map<int, std::deque<Change>, std::greater<int>> m_queues;
+
+	//目录摘要
+	std::unordered_map<std::string, Summary> m_summaries;
+
+	//投递线程是否退出
+	bool m_scheduleQuit = false;
 
 	//后缀
 	std::vector<std::string> m_suffixes;
 
+	//排除规则
+	std::vector<std::string> m_excludes;
+
 	//错误信息
 	std::string m_error = "未知错误";
 
@@ -243,6 +1098,133 @@ private:
 
 	//是否暂停
 	bool m_pause = false;
+
+	//轮询条目
+	struct Entry
+	{
+		Event event;
+		uint32_t offset;
+	};
+
+	//轮询队列
+	struct Queue
+	{
+		std::vector<Entry> entries;
+		std::string data;
+		size_t index = 0;
+
+		//清空(保留已分配的内存)
+		void clear();
+	};
+
+	//是否轮询
+	bool m_poll = false;
+
+	//轮询容量
+	size_t m_capacity = 0;
+
+	//轮询丢弃个数
+	uint64_t m_dropped = 0;
+
+	//轮询锁
+	mutable std::mutex m_mutex;
+
+	//待取队列(监控线程写入)
+	Queue m_pending;
+
+	//读取队列(仅poll线程访问)
+	Queue m_drain;
+
+	//轮询句柄
+	void* m_event = nullptr;
+
+	//文件指纹
+	struct Fingerprint
+	{
+		uint64_t size;
+		uint64_t mtime;
+		uint64_t hash;
+		bool hashed;
+	};
+
+	//线程池
+	class Pool
+	{
+	public:
+		~Pool();
+
+		//启动(已启动时忽略)
+		void start(size_t count);
+
+		//停止(drain为true时执行完已投递的任务,否则丢弃未执行的任务)
+		void stop(bool drain = false);
+
+		//投递任务(已停止时丢弃并返回false)
+		bool post(std::function<void()> task);
+
+	private:
+		std::vector<std::thread> m_threads;
+		std::deque<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		bool m_quit = false;
+	};
+
+	//是否内容过滤
+	bool m_content = false;
+
+	//哈希大小上限
+	uint64_t m_limit = 0;
+
+	//指纹锁
+	std::mutex m_fingerprintMutex;
+
+	//文件指纹
+	std::unordered_map<std::string, Fingerprint> m_fingerprints;
+
+	//正在比较的文件
+	std::unordered_set<std::string> m_comparing;
+
+	//哈希线程池
+	Pool m_hashPool;
+
+	//哈希线程数
+	size_t m_hashThreads = 1;
+
+	//扫描线程(拆分监控的子目录遍历不占用共享的事件循环线程)
+	Pool m_surveyPool;
+
+	//是否填充元数据
+	bool m_metadata = false;
+
+	//是否驻留路径
+	bool m_intern = false;
+
+	//目录驻留表
+	Interner m_interner;
+
+	//轮询线程
+	std::thread m_sweeper;
+
+	//正在轮询的路径(由m_loopMutex保护)
+	std::vector<Arg*> m_polls;
+
+	//轮询线程是否退出
+	bool m_sweepQuit = false;
+
+	//是否唤醒轮询线程
+	bool m_sweepWake = false;
+
+	//扫描线程池
+	Pool m_scanPool;
+
+	//扫描线程个数
+	size_t m_scanThreads = 0;
+
+	//扫描间隔范围(毫秒)
+	static const uint32_t MIN_INTERVAL = 1000;
+
+	static const uint32_t MAX_INTERVAL = 60000;
 };
 
 #define FILE_GUARD_C_API
@@ -273,7 +1255,22 @@ enum file_guard_action
 	renamed_old_name_action,
 
 	//重命名新名称动作
-	renamed_new_name_action
+	renamed_new_name_action,
+
+	//目录摘要动作
+	dirty_action
+};
+
+enum file_guard_kind
+{
+	//未知
+	unknown_kind,
+
+	//文件
+	file_kind,
+
+	//目录
+	directory_kind
 };
 
 struct file_guard_path
@@ -282,6 +1279,153 @@ struct file_guard_path
 	bool subpath;
 };
 
+struct file_guard_event
+{
+	//动作
+	uint32_t action;
+
+	//路径在缓冲区中的偏移
+	uint32_t offset;
+
+	//路径长度(不含'\0')
+	uint32_t length;
+
+	//时间戳(微秒,单调时钟,取自内核读取完成时)
+	uint64_t timestamp;
+
+	//序号(同一对象内从1开始按观察顺序递增)
+	uint64_t sequence;
+
+	//文件类型(file_guard_kind,需启用元数据)
+	uint32_t kind;
+
+	//文件属性
+	uint32_t attributes;
+
+	//文件大小
+	uint64_t size;
+
+	//修改时间(FILETIME格式)
+	uint64_t mtime;
+
+	//文件ID
+	uint64_t id;
+
+	//卷序列号
+	uint32_t volume;
+
+	//各动作次数(仅目录摘要动作)
+	uint32_t counts[5];
+
+	//目录ID(仅启用路径驻留时非0,此时文件只含名称)
+	uint32_t directory;
+};
+
+enum file_guard_backend
+{
+	//自动
+	auto_backend,
+
+	//变化通知
+	notify_backend,
+
+	//轮询
+	polling_backend
+};
+
+enum file_guard_mask
+{
+	//文件名变化
+	file_name_mask = 0x00000001,
+
+	//目录名变化
+	dir_name_mask = 0x00000002,
+
+	//属性变化
+	attributes_mask = 0x00000004,
+
+	//大小变化
+	size_mask = 0x00000008,
+
+	//最后写入时间变化
+	last_write_mask = 0x00000010,
+
+	//最后访问时间变化
+	last_access_mask = 0x00000020,
+
+	//创建时间变化
+	creation_mask = 0x00000040,
+
+	//安全描述符变化
+	security_mask = 0x00000100,
+
+	//默认掩码
+	default_mask = file_name_mask | dir_name_mask | last_write_mask
+};
+
+struct file_guard_option
+{
+	//是否监控子路径
+	bool subpath;
+
+	//优先级(数值越大越先投递)
+	int priority;
+
+	//速率限制(每秒事件个数,0代表不限制)
+	double rate;
+
+	//突发容量(事件个数,0代表与速率相同)
+	double burst;
+
+	//订阅掩码(file_guard_mask的组合,0代表默认)
+	uint32_t mask;
+
+	//动作掩码(1 << file_guard_action的组合,0代表所有动作)
+	uint32_t actions;
+
+	//存在排除规则时不拆分监控(仅在用户态丢弃被排除的事件)
+	bool no_prune;
+
+	//监控方式(file_guard_backend)
+	int backend;
+
+	//轮询间隔(毫秒,0代表自适应)
+	uint32_t interval;
+
+	//是否只交付目录摘要
+	bool aggregate;
+
+	//自动切换为目录摘要的事件速率(每秒事件个数,0代表不自动切换)
+	double aggregate_rate;
+};
+
+struct file_guard_statistics
+{
+	//完成的读取次数(轮询方式为完成的扫描次数)
+	uint64_t reads;
+
+	//读取的字节数
+	uint64_t bytes;
+
+	//缓冲区溢出次数
+	uint64_t overflows;
+
+	//通过过滤的事件个数
+	uint64_t decoded;
+
+	//合并为目录摘要的事件个数
+	uint64_t coalesced;
+
+	//交付的事件个数
+	uint64_t delivered;
+
+	//轮询队列已满丢弃的事件个数
+	uint64_t dropped;
+
+	//读取完成到交付的延迟分布(下标i为[2^i, 2^(i+1))微秒)
+	uint64_t latencies[32];
+};
+
 #if defined(__cplusplus)
 extern "C" {
 #endif // !__cplusplus
@@ -294,15 +1438,24 @@ extern "C" {
 
 	FILE_GUARD_DLL_EXPORT bool file_guard_add_path(void* guard, const char* path, bool subpath);
 
+	FILE_GUARD_DLL_EXPORT bool file_guard_add_path_ex(void* guard, const char* path, const struct file_guard_option* option);
+
 	FILE_GUARD_DLL_EXPORT void file_guard_remove_path(void* guard, const char* path);
 
 	FILE_GUARD_DLL_EXPORT void file_guard_clear_paths(void* guard);
 
 	FILE_GUARD_DLL_EXPORT int file_guard_get_paths(void* guard, struct file_guard_path* path, int size);
 
+	FILE_GUARD_DLL_EXPORT bool file_guard_find_path(void* guard, const char* file, char* path, int size);
+
+	FILE_GUARD_DLL_EXPORT bool file_guard_set_aggregate(void* guard, const char* path, bool aggregate);
+
 	FILE_GUARD_DLL_EXPORT void file_guard_set_on_changed_callback(void* guard,
 		void (*callback)(uint32_t action, const char* file, void* user), void* user);
 
+	FILE_GUARD_DLL_EXPORT void file_guard_set_on_changed_ex_callback(void* guard,
+		void (*callback)(const struct file_guard_event* event, const char* file, void* user), void* user);
+
 	FILE_GUARD_DLL_EXPORT void file_guard_set_on_status_callback(void* guard,
 		void (*callback)(int status, uint32_t thread, const char* path, void* user), void* user);
 
@@ -324,6 +1477,22 @@ extern "C" {
 
 	FILE_GUARD_DLL_EXPORT bool file_guard_is_start(void* guard);
 
+	FILE_GUARD_DLL_EXPORT uint64_t file_guard_get_start_latency(void* guard);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_guard_get_stop_latency(void* guard);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_get_statistics(void* guard, struct file_guard_statistics* statistics);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_reset_statistics(void* guard);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_guard_get_percentile(const struct file_guard_statistics* statistics, double percentile);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_guard_get_sequence(void* guard);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_set_trace(bool enable);
+
+	FILE_GUARD_DLL_EXPORT bool file_guard_dump_trace(const char* file);
+
 	FILE_GUARD_DLL_EXPORT void file_guard_get_error(void* guard, char* error, int size);
 
 	FILE_GUARD_DLL_EXPORT void file_guard_add_suffix(void* guard, const char* suffix);
@@ -334,6 +1503,29 @@ extern "C" {
 
 	FILE_GUARD_DLL_EXPORT int file_guard_get_suffixes(void* guard, char (*suffixes)[256], int size);
 
+	FILE_GUARD_DLL_EXPORT void file_guard_add_exclude(void* guard, const char* rule);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_remove_exclude(void* guard, const char* rule);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_clear_excludes(void* guard);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_set_poll_mode(void* guard, bool enable, int capacity);
+
+	FILE_GUARD_DLL_EXPORT int file_guard_poll(void* guard, struct file_guard_event* events, int max,
+		char* buffer, int size, int timeout_ms);
+
+	FILE_GUARD_DLL_EXPORT void* file_guard_get_poll_handle(void* guard);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_guard_get_poll_dropped(void* guard);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_set_content_filter(void* guard, bool enable, uint64_t limit, int threads);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_set_metadata(void* guard, bool enable);
+
+	FILE_GUARD_DLL_EXPORT void file_guard_set_intern(void* guard, bool enable);
+
+	FILE_GUARD_DLL_EXPORT const char* file_guard_get_directory(void* guard, uint32_t id);
+
 #if defined(__cplusplus)
 }
 #endif // !__cplusplus
@@ -0,0 +1,950 @@
+﻿#include "FileJournal.h"
+#include <Windows.h>
+
+//段头(位于段文件起始处,读取者据此判断可见的记录范围)
+struct SegmentHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t first;
+	volatile LONG64 next;
+	volatile LONG64 committed;
+	uint64_t created;
+	volatile LONG sealed;
+	uint32_t reserved[5];
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "segment header size");
+
+//记录头(其后为路径,整条记录按8字节对齐)
+struct RecordHeader
+{
+	uint32_t size;
+	uint32_t length;
+	uint64_t sequence;
+	uint64_t time;
+	uint16_t action;
+	uint16_t kind;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(RecordHeader) == 32, "record header size");
+
+static const uint32_t SEGMENT_MAGIC = 0x314A4746; //FGJ1
+
+static const uint32_t SEGMENT_VERSION = 1;
+
+//按时长保留时的检查间隔(秒)
+static const uint32_t RETAIN_INTERVAL = 60;
+
+//段文件名称
+static std::string segmentName(const std::string& dir, uint64_t first)
+{
+	char name[64] = { 0 };
+	sprintf_s(name, "%020llu.journal", static_cast<unsigned long long>(first));
+	return dir + name;
+}
+
+//列出段文件的首个序号(升序)
+static void listSegments(const std::string& dir, std::vector<uint64_t>& firsts)
+{
+	firsts.clear();
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "*.journal").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		return;
+	}
+
+	do {
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && strlen(data.cFileName) == 28) {
+			firsts.push_back(strtoull(data.cFileName, nullptr, 10));
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+	std::sort(firsts.begin(), firsts.end());
+}
+
+//读取游标文件
+static bool readCursor(const std::string& file, uint64_t& sequence)
+{
+	HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	DWORD bytes = 0;
+	const bool result = ReadFile(handle, &sequence, sizeof(sequence), &bytes, nullptr) && bytes == sizeof(sequence);
+	CloseHandle(handle);
+	return result;
+}
+
+//当前时间(FILETIME格式)
+static uint64_t now()
+{
+	FILETIME time;
+	GetSystemTimeAsFileTime(&time);
+	return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+}
+
+FileJournal::FileJournal()
+{
+}
+
+FileJournal::~FileJournal()
+{
+	close();
+}
+
+bool FileJournal::open(const std::string& dir)
+{
+	return open(dir, Option());
+}
+
+bool FileJournal::open(const std::string& dir, const Option& option)
+{
+	bool result = false;
+	do {
+		if (m_open) {
+			setLastError("日志已打开");
+			break;
+		}
+
+		if (dir.empty() || option.segment < sizeof(SegmentHeader) + 64 * 1024) {
+			setLastError("日志目录为空或段文件过小");
+			break;
+		}
+
+		m_dir = dir;
+		for (auto& x : m_dir) {
+			if (x == '/') {
+				x = '\\';
+			}
+		}
+
+		if (m_dir.back() != '\\') {
+			m_dir.append("\\");
+		}
+
+		if (!CreateDirectoryA(m_dir.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+			setLastError("创建%s目录失败,错误代码:%lu", m_dir.c_str(), GetLastError());
+			break;
+		}
+
+		m_option = option;
+		if (!m_option.interval) {
+			m_option.interval = 1;
+		}
+
+		//最后一段未封存时继续写入,否则从其后的序号开始新段
+		std::vector<uint64_t> firsts;
+		listSegments(m_dir, firsts);
+		if (firsts.empty()) {
+			if (!roll(1)) {
+				break;
+			}
+		}
+		else if (!resume(segmentName(m_dir, firsts.back()))) {
+			break;
+		}
+
+		m_sequence = m_next;
+		m_committed = m_next - 1;
+		m_dropped = 0;
+		m_quit = false;
+		m_compact = false;
+		m_pending.clear();
+		m_writing.clear();
+		m_open = true;
+		m_writer = std::thread(&FileJournal::write, this);
+		result = true;
+	} while (false);
+	return result;
+}
+
+void FileJournal::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_open) {
+			return;
+		}
+		m_open = false;
+		m_quit = true;
+	}
+	m_cond.notify_all();
+
+	if (m_writer.joinable()) {
+		m_writer.join();
+	}
+
+	if (m_view) {
+		FlushViewOfFile(m_view, 0);
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+	}
+
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+}
+
+bool FileJournal::isOpen() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_open;
+}
+
+bool FileJournal::append(const FileGuard::Event& event)
+{
+	if (!event.file) {
+		return false;
+	}
+
+	//目录摘要不是单个文件的事件,不写入日志
+	if (event.action == FileGuard::Action::DIRTY) {
+		return false;
+	}
+
+	const uint32_t length = event.length ? event.length : static_cast<uint32_t>(strlen(event.file));
+	const uint32_t size = (sizeof(RecordHeader) + length + 1 + 7) & ~7u;
+	const uint64_t time = now();
+
+	//只在锁内编码到待写入队列,不等待磁盘
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_open) {
+		return false;
+	}
+
+	if (m_pending.size() + size > m_option.capacity) {
+		++m_dropped;
+		return false;
+	}
+
+	const size_t offset = m_pending.size();
+	m_pending.resize(offset + size);
+	RecordHeader* header = reinterpret_cast<RecordHeader*>(&m_pending[offset]);
+	header->size = size;
+	header->length = length;
+	header->sequence = m_sequence++;
+	header->time = time;
+	header->action = static_cast<uint16_t>(event.action);
+	header->kind = static_cast<uint16_t>(event.kind);
+	header->reserved = 0;
+	memcpy(header + 1, event.file, length);
+	memset(reinterpret_cast<char*>(header + 1) + length, 0, size - sizeof(RecordHeader) - length);
+
+	//队列为空时唤醒写入线程,之后的事件由同一次提交带走
+	if (offset == 0) {
+		m_cond.notify_one();
+	}
+	return true;
+}
+
+bool FileJournal::append(uint32_t action, const char* file)
+{
+	FileGuard::Event event = FileGuard::Event();
+	event.action = action;
+	event.file = file;
+	event.length = file ? static_cast<uint32_t>(strlen(file)) : 0;
+	return append(event);
+}
+
+uint64_t FileJournal::getSequence() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sequence;
+}
+
+uint64_t FileJournal::getCommitted() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_committed;
+}
+
+uint64_t FileJournal::getDropped() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dropped;
+}
+
+void FileJournal::compact()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_compact = true;
+	}
+	m_cond.notify_all();
+}
+
+const char* FileJournal::getLastError() const
+{
+	return m_error.c_str();
+}
+
+void FileJournal::setLastError(const char* fmt, ...)
+{
+	char buff[512] = { 0 };
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(buff, sizeof(buff), fmt, ap);
+	va_end(ap);
+	m_error = buff;
+}
+
+void FileJournal::write()
+{
+	uint64_t check = GetTickCount64();
+	while (true) {
+		bool quit = false, compact = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait_for(lock, std::chrono::seconds(RETAIN_INTERVAL), [this]() {
+				return !m_pending.empty() || m_quit || m_compact;
+			});
+
+			//攒够一个提交间隔再写入,每批只更新一次段头
+			if (!m_quit && !m_pending.empty()) {
+				m_cond.wait_for(lock, std::chrono::milliseconds(m_option.interval), [this]() { return m_quit; });
+			}
+
+			m_writing.clear();
+			std::swap(m_pending, m_writing);
+			quit = m_quit;
+			compact = m_compact;
+			m_compact = false;
+		}
+
+		if (!m_writing.empty()) {
+			store(m_writing);
+			commit();
+		}
+
+		//切换过段或到达检查间隔时执行保留策略
+		const uint64_t tick = GetTickCount64();
+		if (compact || m_rolled || tick - check >= RETAIN_INTERVAL * 1000ull) {
+			if (m_option.retainBytes || m_option.retainSeconds) {
+				retain();
+			}
+			check = tick;
+			m_rolled = false;
+		}
+
+		if (quit) {
+			break;
+		}
+	}
+}
+
+void FileJournal::store(const std::vector<char>& data)
+{
+	const uint64_t capacity = m_option.segment;
+	size_t offset = 0;
+	while (offset < data.size()) {
+		const RecordHeader* header = reinterpret_cast<const RecordHeader*>(&data[offset]);
+		if (m_view && m_tail + header->size > capacity) {
+			commit();
+			seal();
+		}
+
+		if (!m_view && !roll(header->sequence)) {
+			//无法创建新段(如磁盘已满),丢弃本批剩余的记录
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = offset; i < data.size(); i += reinterpret_cast<const RecordHeader*>(&data[i])->size) {
+				++m_dropped;
+			}
+			return;
+		}
+
+		//将当前段能容纳的连续记录一次复制
+		size_t end = offset;
+		uint64_t tail = m_tail;
+		while (end < data.size()) {
+			const RecordHeader* record = reinterpret_cast<const RecordHeader*>(&data[end]);
+			if (tail + record->size > capacity) {
+				break;
+			}
+			tail += record->size;
+			m_next = record->sequence + 1;
+			end += record->size;
+		}
+
+		memcpy(m_view + m_tail, &data[offset], end - offset);
+		m_tail = tail;
+		offset = end;
+	}
+}
+
+void FileJournal::commit()
+{
+	if (!m_view) {
+		return;
+	}
+
+	SegmentHeader* header = reinterpret_cast<SegmentHeader*>(m_view);
+	if (m_option.flush) {
+		FlushViewOfFile(m_view + header->committed, static_cast<SIZE_T>(m_tail - header->committed));
+	}
+
+	//记录先于提交位置可见
+	InterlockedExchange64(&header->next, static_cast<LONG64>(m_next));
+	InterlockedExchange64(&header->committed, static_cast<LONG64>(m_tail));
+	if (m_option.flush) {
+		FlushViewOfFile(m_view, sizeof(SegmentHeader));
+		FlushFileBuffers(m_file);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_committed = m_next - 1;
+}
+
+bool FileJournal::roll(uint64_t first)
+{
+	bool result = false;
+	const std::string name = segmentName(m_dir, first);
+	do {
+		m_file = CreateFileA(name.c_str(),
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr,
+			CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = nullptr;
+			setLastError("创建%s段文件失败,错误代码:%lu", name.c_str(), GetLastError());
+			break;
+		}
+
+		//映射时将文件扩展到段大小
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(m_option.segment >> 32), static_cast<DWORD>(m_option.segment), nullptr);
+		if (!m_mapping) {
+			setLastError("映射%s段文件失败,错误代码:%lu", name.c_str(), GetLastError());
+			break;
+		}
+
+		m_view = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0));
+		if (!m_view) {
+			setLastError("映射%s段文件视图失败,错误代码:%lu", name.c_str(), GetLastError());
+			break;
+		}
+
+		SegmentHeader* header = reinterpret_cast<SegmentHeader*>(m_view);
+		memset(header, 0, sizeof(SegmentHeader));
+		header->magic = SEGMENT_MAGIC;
+		header->version = SEGMENT_VERSION;
+		header->first = first;
+		header->next = static_cast<LONG64>(first);
+		header->committed = sizeof(SegmentHeader);
+		header->created = now();
+		m_tail = sizeof(SegmentHeader);
+		m_next = first;
+		m_rolled = true;
+		result = true;
+	} while (false);
+
+	if (!result) {
+		seal();
+		DeleteFileA(name.c_str());
+	}
+	return result;
+}
+
+bool FileJournal::resume(const std::string& file)
+{
+	bool result = false;
+	uint64_t next = 1;
+	do {
+		m_file = CreateFileA(file.c_str(),
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = nullptr;
+			setLastError("打开%s段文件失败,错误代码:%lu", file.c_str(), GetLastError());
+			break;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || static_cast<uint64_t>(size.QuadPart) < sizeof(SegmentHeader)) {
+			setLastError("%s段文件已损坏", file.c_str());
+			break;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		m_view = m_mapping ? static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0)) : nullptr;
+		if (!m_view) {
+			setLastError("映射%s段文件失败,错误代码:%lu", file.c_str(), GetLastError());
+			break;
+		}
+
+		const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(m_view);
+		if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION ||
+			static_cast<uint64_t>(header->committed) > static_cast<uint64_t>(size.QuadPart)) {
+			setLastError("%s段文件已损坏", file.c_str());
+			break;
+		}
+
+		//提交位置之后的内容(崩溃前未提交的记录)被覆盖
+		next = static_cast<uint64_t>(header->next);
+		m_tail = static_cast<uint64_t>(header->committed);
+		m_next = next;
+		if (header->sealed || static_cast<uint64_t>(size.QuadPart) != m_option.segment) {
+			seal();
+			result = roll(next);
+			break;
+		}
+		result = true;
+	} while (false);
+
+	if (!result && m_view) {
+		seal();
+	}
+	return result;
+}
+
+void FileJournal::seal()
+{
+	if (m_view) {
+		InterlockedExchange(&reinterpret_cast<SegmentHeader*>(m_view)->sealed, 1);
+		if (m_option.flush) {
+			FlushViewOfFile(m_view, 0);
+		}
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+	}
+
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+}
+
+void FileJournal::retain()
+{
+	std::vector<uint64_t> firsts;
+	listSegments(m_dir, firsts);
+	if (firsts.size() < 2) {
+		return;
+	}
+
+	//所有游标中最小的位置,其之前的记录均已被读取
+	uint64_t unread = UINT64_MAX;
+	if (m_option.retainUnread) {
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((m_dir + "*.cursor").c_str(), &data);
+		if (find != INVALID_HANDLE_VALUE) {
+			do {
+				uint64_t sequence = 0;
+				if (readCursor(m_dir + data.cFileName, sequence)) {
+					unread = (std::min)(unread, sequence);
+				}
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+		}
+	}
+
+	std::vector<uint64_t> sizes(firsts.size(), 0), times(firsts.size(), 0);
+	uint64_t total = 0;
+	for (size_t i = 0; i < firsts.size(); ++i) {
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (GetFileAttributesExA(segmentName(m_dir, firsts[i]).c_str(), GetFileExInfoStandard, &data)) {
+			sizes[i] = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+			times[i] = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+			total += sizes[i];
+		}
+	}
+
+	//从最旧的段开始删除,当前段始终保留
+	const uint64_t expire = now() - m_option.retainSeconds * 10000000ull;
+	for (size_t i = 0; i + 1 < firsts.size(); ++i) {
+		const bool over = m_option.retainBytes && total > m_option.retainBytes;
+		const bool old = m_option.retainSeconds && times[i] < expire;
+		if (!over && !old) {
+			break;
+		}
+
+		//下一段的首个序号即为本段之后的序号
+		if (firsts[i + 1] > unread) {
+			break;
+		}
+
+		if (!DeleteFileA(segmentName(m_dir, firsts[i]).c_str())) {
+			break;
+		}
+		total -= sizes[i];
+	}
+}
+
+FileJournal::Reader::Reader()
+{
+}
+
+FileJournal::Reader::~Reader()
+{
+	close();
+}
+
+bool FileJournal::Reader::open(const std::string& dir, const std::string& name)
+{
+	close();
+	m_dir = dir;
+	for (auto& x : m_dir) {
+		if (x == '/') {
+			x = '\\';
+		}
+	}
+
+	if (m_dir.empty() || name.empty()) {
+		m_error = "日志目录或游标名称为空";
+		return false;
+	}
+
+	if (m_dir.back() != '\\') {
+		m_dir.append("\\");
+	}
+
+	const DWORD attributes = GetFileAttributesA(m_dir.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		m_error = m_dir + "目录不存在";
+		return false;
+	}
+
+	m_name = name;
+	m_next = 1;
+	readCursor(m_dir + m_name + ".cursor", m_next);
+	return true;
+}
+
+void FileJournal::Reader::close()
+{
+	unmap();
+}
+
+size_t FileJournal::Reader::read(Record* records, size_t count, char* buffer, size_t size, uint32_t timeout)
+{
+	size_t result = 0, used = 0;
+	const uint64_t deadline = GetTickCount64() + timeout;
+	while (records && count && buffer && size && !m_dir.empty()) {
+		if (!m_view && !map(m_next)) {
+			if (GetTickCount64() >= deadline) {
+				break;
+			}
+			Sleep(10);
+			continue;
+		}
+
+		const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(m_view);
+		const LONG sealed = InterlockedCompareExchange(const_cast<volatile LONG*>(&header->sealed), 0, 0);
+		const uint64_t committed = (std::min)(m_size, static_cast<uint64_t>(
+			InterlockedCompareExchange64(const_cast<volatile LONG64*>(&header->committed), 0, 0)));
+
+		bool full = false;
+		while (result < count && m_offset + sizeof(RecordHeader) <= committed) {
+			const RecordHeader* record = reinterpret_cast<const RecordHeader*>(m_view + m_offset);
+			if (used + record->length + 1 > size) {
+				full = true;
+				break;
+			}
+
+			memcpy(buffer + used, record + 1, record->length);
+			buffer[used + record->length] = 0;
+
+			Record& x = records[result++];
+			x.sequence = record->sequence;
+			x.time = record->time;
+			x.action = record->action;
+			x.kind = record->kind;
+			x.file = buffer + used;
+			x.length = record->length;
+
+			used += record->length + 1;
+			m_offset += record->size;
+			m_next = record->sequence + 1;
+		}
+
+		if (result || full) {
+			break;
+		}
+
+		//已封存的段读完后切换到下一段,下一段尚未创建(封存与创建之间,或创建失败)时按超时等待
+		if (sealed && m_offset >= committed) {
+			std::vector<uint64_t> firsts;
+			listSegments(m_dir, firsts);
+			auto next = std::upper_bound(firsts.begin(), firsts.end(), header->first);
+			if (next != firsts.end()) {
+				//创建新段失败时已分配序号的记录被丢弃,两段之间留有空缺,游标须越过空缺,否则会重新映射本段
+				m_next = (std::max)(m_next, *next);
+				unmap();
+				if (GetTickCount64() >= deadline) {
+					break;
+				}
+				continue;
+			}
+		}
+
+		if (GetTickCount64() >= deadline) {
+			break;
+		}
+		Sleep(static_cast<DWORD>((std::min<uint64_t>)(10, deadline - GetTickCount64())));
+	}
+	return result;
+}
+
+bool FileJournal::Reader::commit()
+{
+	if (m_dir.empty()) {
+		return false;
+	}
+
+	//先写临时文件再替换,崩溃时游标文件要么是旧值要么是新值
+	const std::string file = m_dir + m_name + ".cursor";
+	const std::string temp = file + ".tmp";
+	HANDLE handle = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		m_error = "创建" + temp + "文件失败";
+		return false;
+	}
+
+	DWORD bytes = 0;
+	const bool result = WriteFile(handle, &m_next, sizeof(m_next), &bytes, nullptr) && bytes == sizeof(m_next) &&
+		FlushFileBuffers(handle);
+	CloseHandle(handle);
+	if (!result || !MoveFileExA(temp.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		m_error = "写入" + file + "文件失败";
+		return false;
+	}
+	return true;
+}
+
+void FileJournal::Reader::seek(uint64_t sequence)
+{
+	unmap();
+	m_next = sequence ? sequence : 1;
+}
+
+uint64_t FileJournal::Reader::getPosition() const
+{
+	return m_next;
+}
+
+const char* FileJournal::Reader::getLastError() const
+{
+	return m_error.c_str();
+}
+
+bool FileJournal::Reader::map(uint64_t sequence)
+{
+	std::vector<uint64_t> firsts;
+	listSegments(m_dir, firsts);
+	if (firsts.empty()) {
+		return false;
+	}
+
+	//游标之前的段已被删除时,从最旧的记录继续
+	size_t index = 0;
+	while (index + 1 < firsts.size() && firsts[index + 1] <= sequence) {
+		++index;
+	}
+
+	if (sequence < firsts[index]) {
+		sequence = firsts[index];
+		m_next = sequence;
+	}
+
+	bool result = false;
+	do {
+		const std::string name = segmentName(m_dir, firsts[index]);
+		m_file = CreateFileA(name.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			m_file = nullptr;
+			break;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || static_cast<uint64_t>(size.QuadPart) < sizeof(SegmentHeader)) {
+			break;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_view = m_mapping ? static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (!m_view) {
+			break;
+		}
+
+		const SegmentHeader* header = reinterpret_cast<const SegmentHeader*>(m_view);
+		if (header->magic != SEGMENT_MAGIC || header->version != SEGMENT_VERSION) {
+			m_error = name + "段文件已损坏";
+			break;
+		}
+
+		//跳过序号小于游标的记录
+		m_size = static_cast<uint64_t>(size.QuadPart);
+		m_offset = sizeof(SegmentHeader);
+		const uint64_t committed = (std::min)(m_size, static_cast<uint64_t>(header->committed));
+		while (m_offset + sizeof(RecordHeader) <= committed) {
+			const RecordHeader* record = reinterpret_cast<const RecordHeader*>(m_view + m_offset);
+			if (record->sequence >= sequence) {
+				break;
+			}
+			m_offset += record->size;
+		}
+		result = true;
+	} while (false);
+
+	if (!result) {
+		unmap();
+	}
+	return result;
+}
+
+void FileJournal::Reader::unmap()
+{
+	if (m_view) {
+		UnmapViewOfFile(m_view);
+		m_view = nullptr;
+	}
+
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file) {
+		CloseHandle(m_file);
+		m_file = nullptr;
+	}
+	m_size = 0;
+	m_offset = 0;
+}
+
+#if defined(FILE_GUARD_C_API)
+
+#define get_journal(x) ((FileJournal*)(x))
+
+#define get_reader(x) ((FileJournal::Reader*)(x))
+
+void* file_journal_new()
+{
+	return new FileJournal;
+}
+
+void file_journal_free(void* journal)
+{
+	if (journal) {
+		delete static_cast<FileJournal*>(journal);
+	}
+}
+
+bool file_journal_open(void* journal, const char* dir, const file_journal_option* option)
+{
+	FileJournal::Option temp;
+	if (option) {
+		temp.segment = option->segment ? option->segment : temp.segment;
+		temp.interval = option->interval ? option->interval : temp.interval;
+		temp.flush = option->flush;
+		temp.retainBytes = option->retain_bytes;
+		temp.retainSeconds = option->retain_seconds;
+		temp.retainUnread = !option->drop_unread;
+	}
+	return get_journal(journal)->open(dir, temp);
+}
+
+void file_journal_close(void* journal)
+{
+	get_journal(journal)->close();
+}
+
+bool file_journal_append(void* journal, uint32_t action, const char* file)
+{
+	return get_journal(journal)->append(action, file);
+}
+
+uint64_t file_journal_get_committed(void* journal)
+{
+	return get_journal(journal)->getCommitted();
+}
+
+uint64_t file_journal_get_dropped(void* journal)
+{
+	return get_journal(journal)->getDropped();
+}
+
+void file_journal_compact(void* journal)
+{
+	get_journal(journal)->compact();
+}
+
+void* file_journal_reader_new()
+{
+	return new FileJournal::Reader;
+}
+
+void file_journal_reader_free(void* reader)
+{
+	if (reader) {
+		delete static_cast<FileJournal::Reader*>(reader);
+	}
+}
+
+bool file_journal_reader_open(void* reader, const char* dir, const char* name)
+{
+	return get_reader(reader)->open(dir, name);
+}
+
+int file_journal_reader_read(void* reader, file_journal_record* records, int max, char* buffer, int size, int timeout_ms)
+{
+	if (!records || max <= 0 || !buffer || size <= 0) {
+		return 0;
+	}
+
+	std::vector<FileJournal::Record> temp(max);
+	const size_t count = get_reader(reader)->read(temp.data(), temp.size(), buffer, size, timeout_ms > 0 ? timeout_ms : 0);
+	for (size_t i = 0; i < count; ++i) {
+		records[i].sequence = temp[i].sequence;
+		records[i].time = temp[i].time;
+		records[i].action = temp[i].action;
+		records[i].kind = temp[i].kind;
+		records[i].offset = static_cast<uint32_t>(temp[i].file - buffer);
+		records[i].length = temp[i].length;
+	}
+	return static_cast<int>(count);
+}
+
+bool file_journal_reader_commit(void* reader)
+{
+	return get_reader(reader)->commit();
+}
+
+void file_journal_reader_seek(void* reader, uint64_t sequence)
+{
+	get_reader(reader)->seek(sequence);
+}
+
+uint64_t file_journal_reader_get_position(void* reader)
+{
+	return get_reader(reader)->getPosition();
+}
+
+#endif // !FILE_GUARD_C_API
@@ -0,0 +1,365 @@
+﻿#ifndef __FILE_JOURNAL_H__
+#define __FILE_JOURNAL_H__
+
+#include "FileGuard.h"
+
+/*
+* 只追加的事件日志.
+* 日志目录中包含若干段文件(以首个序号命名),每条记录带有序号与写入时间.
+* 追加只在内存中排队,由后台线程成批写入内存映射的段尾并一次性提交,
+* 读取者通过持久化的游标从上次停止的位置继续.
+*/
+class FileJournal
+{
+public:
+	// 日志选项
+	struct Option
+	{
+		// 段文件大小(字节),写满后切换到新段
+		uint64_t segment = 64 * 1024 * 1024;
+
+		// 成批提交的间隔(毫秒)
+		uint32_t interval = 10;
+
+		// 待写入队列的上限(字节),超出时丢弃新事件而不阻塞监控线程
+		size_t capacity = 64 * 1024 * 1024;
+
+		// 每次提交是否刷新到磁盘(否则由系统延迟写入,进程崩溃不丢失,断电可能丢失)
+		bool flush = false;
+
+		// 保留的总大小(字节,0代表不限制),超出时删除最旧的段
+		uint64_t retainBytes = 0;
+
+		// 保留的时长(秒,0代表不限制),早于此时长的段被删除
+		uint32_t retainSeconds = 0;
+
+		// 是否保留尚未被所有游标读完的段
+		bool retainUnread = true;
+	};
+
+	// 日志记录
+	struct Record
+	{
+		// 序号(从1开始连续递增)
+		uint64_t sequence;
+
+		// 写入时间(FILETIME格式)
+		uint64_t time;
+
+		// 动作
+		uint32_t action;
+
+		// 文件类型(FileGuard::Kind,需启用元数据)
+		uint32_t kind;
+
+		// 文件
+		const char* file;
+
+		// 文件长度(不含'\0')
+		uint32_t length;
+	};
+
+	// 读取者
+	class Reader
+	{
+	public:
+		Reader();
+
+		~Reader();
+
+		Reader(const Reader&) = delete;
+
+		Reader& operator=(const Reader&) = delete;
+
+		/*
+		* @brief 打开
+		* @param[in] dir 日志目录
+		* @param[in] name 游标名称(保存为目录中的name.cursor,不存在时从最旧的记录开始)
+		* @retval true 成功
+		* @retval false 失败
+		*/
+		bool open(const std::string& dir, const std::string& name);
+
+		/*
+		* @brief 关闭(不提交游标)
+		* @return void
+		*/
+		void close();
+
+		/*
+		* @brief 读取记录
+		* @param[out] records 记录数组
+		* @param[in] count 记录数组大小
+		* @param[out] buffer 路径缓冲区,记录中的文件指向此缓冲区
+		* @param[in] size 路径缓冲区大小
+		* @param[in] timeout 已读到末尾时等待新记录的时间(毫秒)
+		* @return 读取的记录个数
+		*/
+		size_t read(Record* records, size_t count, char* buffer, size_t size, uint32_t timeout = 0);
+
+		/*
+		* @brief 提交游标(已读取的记录在下次打开时不再返回)
+		* @retval true 成功
+		* @retval false 失败
+		*/
+		bool commit();
+
+		/*
+		* @brief 定位
+		* @param[in] sequence 下一条读取的序号
+		* @return void
+		*/
+		void seek(uint64_t sequence);
+
+		/*
+		* @brief 获取位置
+		* @return 下一条读取的序号
+		*/
+		uint64_t getPosition() const;
+
+		/*
+		* @brief 获取最终错误
+		* @return 最终错误
+		*/
+		const char* getLastError() const;
+	private:
+		//映射段文件
+		bool map(uint64_t sequence);
+
+		//解除映射
+		void unmap();
+
+		std::string m_dir;
+		std::string m_name;
+		uint64_t m_next = 1;
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+		char* m_view = nullptr;
+		uint64_t m_size = 0;
+		uint64_t m_offset = 0;
+		std::string m_error;
+	};
+
+	FileJournal();
+
+	~FileJournal();
+
+	FileJournal(const FileJournal&) = delete;
+
+	FileJournal& operator=(const FileJournal&) = delete;
+
+	/*
+	* @brief 打开(目录不存在时创建,最后一段未写满时继续写入)
+	* @param[in] dir 日志目录
+	* @retval true 成功
+	* @retval false 失败
+	*/
+	bool open(const std::string& dir);
+
+	/*
+	* @brief 打开
+	* @param[in] dir 日志目录
+	* @param[in] option 选项
+	* @retval true 成功
+	* @retval false 失败
+	*/
+	bool open(const std::string& dir, const Option& option);
+
+	/*
+	* @brief 关闭(写入并提交剩余记录)
+	* @return void
+	*/
+	void close();
+
+	/*
+	* @brief 是否已打开
+	* @return bool
+	*/
+	bool isOpen() const;
+
+	/*
+	* @brief 追加事件(可在监控回调中直接调用,不等待写入)
+	* @param[in] event 事件
+	* @retval true 成功
+	* @retval false 未打开或队列已满
+	*/
+	bool append(const FileGuard::Event& event);
+
+	/*
+	* @brief 追加事件
+	* @param[in] action 动作
+	* @param[in] file 文件
+	* @retval true 成功
+	* @retval false 未打开或队列已满
+	*/
+	bool append(uint32_t action, const char* file);
+
+	/*
+	* @brief 获取序号
+	* @return 下一条追加的记录将使用的序号
+	*/
+	uint64_t getSequence() const;
+
+	/*
+	* @brief 获取已提交的序号
+	* @return 已提交(对读取者可见)的最后一条记录的序号
+	*/
+	uint64_t getCommitted() const;
+
+	/*
+	* @brief 获取丢弃的事件个数
+	* @return 因队列已满而丢弃的事件个数
+	*/
+	uint64_t getDropped() const;
+
+	/*
+	* @brief 立即按保留策略删除旧段
+	* @return void
+	*/
+	void compact();
+
+	/*
+	* @brief 获取最终错误
+	* @return 最终错误
+	*/
+	const char* getLastError() const;
+protected:
+	/*
+	* @brief 设置最终错误
+	* @param[in] fmt 格式化字符串
+	* @param[in] ... 可变参数
+	* @return void
+	*/
+	void setLastError(const char* fmt, ...);
+
+private:
+	//写入线程
+	void write();
+
+	//将一批记录写入段尾
+	void store(const std::vector<char>& data);
+
+	//提交段尾(更新段头中的提交位置)
+	void commit();
+
+	//创建新段
+	bool roll(uint64_t first);
+
+	//打开最后一段继续写入
+	bool resume(const std::string& file);
+
+	//封存并解除映射当前段
+	void seal();
+
+	//按保留策略删除旧段
+	void retain();
+
+	std::string m_dir;
+	Option m_option;
+	std::thread m_writer;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::vector<char> m_pending;
+	std::vector<char> m_writing;
+	uint64_t m_sequence = 1;
+	uint64_t m_committed = 0;
+	uint64_t m_dropped = 0;
+	bool m_quit = false;
+	bool m_compact = false;
+	bool m_open = false;
+
+	//当前段(仅写入线程访问)
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+	char* m_view = nullptr;
+	uint64_t m_tail = 0;
+	uint64_t m_next = 1;
+	bool m_rolled = false;
+
+	std::string m_error;
+};
+
+#if defined(FILE_GUARD_C_API)
+
+struct file_journal_option
+{
+	//段文件大小(字节,0代表默认)
+	uint64_t segment;
+
+	//成批提交的间隔(毫秒,0代表默认)
+	uint32_t interval;
+
+	//每次提交是否刷新到磁盘
+	bool flush;
+
+	//保留的总大小(字节,0代表不限制)
+	uint64_t retain_bytes;
+
+	//保留的时长(秒,0代表不限制)
+	uint32_t retain_seconds;
+
+	//删除尚未被所有游标读完的段
+	bool drop_unread;
+};
+
+struct file_journal_record
+{
+	//序号
+	uint64_t sequence;
+
+	//写入时间(FILETIME格式)
+	uint64_t time;
+
+	//动作
+	uint32_t action;
+
+	//文件类型
+	uint32_t kind;
+
+	//路径在缓冲区中的偏移
+	uint32_t offset;
+
+	//路径长度(不含'\0')
+	uint32_t length;
+};
+
+#if defined(__cplusplus)
+extern "C" {
+#endif // !__cplusplus
+
+	FILE_GUARD_DLL_EXPORT void* file_journal_new();
+
+	FILE_GUARD_DLL_EXPORT void file_journal_free(void* journal);
+
+	FILE_GUARD_DLL_EXPORT bool file_journal_open(void* journal, const char* dir, const struct file_journal_option* option);
+
+	FILE_GUARD_DLL_EXPORT void file_journal_close(void* journal);
+
+	FILE_GUARD_DLL_EXPORT bool file_journal_append(void* journal, uint32_t action, const char* file);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_journal_get_committed(void* journal);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_journal_get_dropped(void* journal);
+
+	FILE_GUARD_DLL_EXPORT void file_journal_compact(void* journal);
+
+	FILE_GUARD_DLL_EXPORT void* file_journal_reader_new();
+
+	FILE_GUARD_DLL_EXPORT void file_journal_reader_free(void* reader);
+
+	FILE_GUARD_DLL_EXPORT bool file_journal_reader_open(void* reader, const char* dir, const char* name);
+
+	FILE_GUARD_DLL_EXPORT int file_journal_reader_read(void* reader, struct file_journal_record* records, int max,
+		char* buffer, int size, int timeout_ms);
+
+	FILE_GUARD_DLL_EXPORT bool file_journal_reader_commit(void* reader);
+
+	FILE_GUARD_DLL_EXPORT void file_journal_reader_seek(void* reader, uint64_t sequence);
+
+	FILE_GUARD_DLL_EXPORT uint64_t file_journal_reader_get_position(void* reader);
+
+#if defined(__cplusplus)
+}
+#endif // !__cplusplus
+#endif // !FILE_GUARD_C_API
+#endif // !__FILE_JOURNAL_H__
@@ -0,0 +1,659 @@
+﻿/*
+* FileGuard压力测试
+* 在临时目录下按逐级提高的速率并发执行创建、写入、重命名、删除与深层目录树增删,
+* 记录每个操作应产生的事件,排空后与onChangedEx收到的事件逐一核对,
+* 报告每一级的丢失率、重复率、乱序数、溢出次数与延迟百分位,用于确定各配置可持续的吞吐量.
+*
+* 编译: cl /EHsc /O2 /std:c++17 /utf-8 stress\FileGuardStress.cpp FileGuard.cpp
+* 用法: FileGuardStress <目录> [-t 线程数] [-s 每级秒数] [-r 速率1,速率2,...] [-d 目录深度]
+*                      [-m mixed|tree|all] [-q 排空毫秒数] [-M] [-i] [-p]
+*   -t 工作线程数(默认4)         -s 每级持续秒数(默认5)
+*   -r 每秒操作数,逗号分隔(默认1000,5000,20000,50000)
+*   -d 目录树深度(默认8)         -m 负载(mixed:文件增改名删,tree:目录树增删,all:交替)
+*   -q 无新事件多久视为排空(默认1000毫秒)
+*   -M 启用元数据  -i 启用路径驻留  -p 设置优先级(回调改由投递线程调用)
+*/
+#include "../FileGuard.h"
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+
+//单调时钟(微秒,与Event::timestamp同源)
+static uint64_t monotonic()
+{
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER li = { 0 };
+		QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	LARGE_INTEGER li = { 0 };
+	QueryPerformanceCounter(&li);
+	return static_cast<uint64_t>(li.QuadPart / frequency * 1000000 + li.QuadPart % frequency * 1000000 / frequency);
+}
+
+//规范化路径(小写,'/'转'\\',合并连续的'\\')
+static std::string normalize(const std::string& path)
+{
+	std::string result;
+	result.reserve(path.size());
+	for (char c : path) {
+		if (c == '/') {
+			c = '\\';
+		}
+		if (c == '\\' && !result.empty() && result.back() == '\\') {
+			continue;
+		}
+		result.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+	}
+	return result;
+}
+
+//核对键(动作+规范化路径)
+static std::string keyOf(uint32_t action, const std::string& file)
+{
+	return std::to_string(action) + '|' + normalize(file);
+}
+
+//递归删除目录
+static void removeTree(const std::string& path)
+{
+	WIN32_FIND_DATAA data = { 0 };
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do
+		{
+			if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+				continue;
+			}
+			std::string child = path + '\\' + data.cFileName;
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+				removeTree(child);
+			}
+			else {
+				SetFileAttributesA(child.c_str(), FILE_ATTRIBUTE_NORMAL);
+				DeleteFileA(child.c_str());
+			}
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+	RemoveDirectoryA(path.c_str());
+}
+
+//负载
+enum Workload
+{
+	MIXED_WORKLOAD,
+	TREE_WORKLOAD,
+	ALL_WORKLOAD,
+};
+
+//配置
+struct Config
+{
+	//监控目录
+	std::string root;
+
+	//工作线程数
+	size_t threads = 4;
+
+	//每级持续秒数
+	uint32_t seconds = 5;
+
+	//各级每秒操作数
+	std::vector<uint32_t> rates = { 1000, 5000, 20000, 50000 };
+
+	//目录树深度
+	uint32_t depth = 8;
+
+	//负载
+	int workload = MIXED_WORKLOAD;
+
+	//排空判定(毫秒)
+	uint32_t quiet = 1000;
+
+	//启用元数据
+	bool metadata = false;
+
+	//启用路径驻留
+	bool intern = false;
+
+	//设置优先级
+	bool priority = false;
+};
+
+//预期事件(操作完成后记录)
+struct Expected
+{
+	//动作
+	uint32_t action;
+
+	//路径
+	std::string file;
+
+	//操作完成时间(微秒)
+	uint64_t time;
+};
+
+//观察到的事件
+struct Observed
+{
+	//动作
+	uint32_t action;
+
+	//路径
+	std::string file;
+
+	//回调时间(微秒)
+	uint64_t time;
+
+	//序号
+	uint64_t sequence;
+};
+
+//观察者(onChangedEx中收集事件)
+struct Observer
+{
+	std::mutex mutex;
+	std::vector<Observed> events;
+	std::atomic<uint64_t> last{ 0 };
+	std::atomic<uint64_t> errors{ 0 };
+};
+
+//工作线程
+class Worker
+{
+public:
+	Worker(const std::string& dir, uint32_t depth, int workload) :
+		m_dir(dir), m_depth(depth), m_workload(workload)
+	{
+	}
+
+	/*
+	* @brief 按速率执行操作直到截止时间
+	* @param[in] rate 本线程每秒操作数
+	* @param[in] deadline 截止时间(微秒)
+	* @return void
+	*/
+	void run(double rate, uint64_t deadline)
+	{
+		const double interval = 1000000.0 / rate;
+		const uint64_t begin = monotonic();
+		for (uint64_t i = 0;; ++i) {
+			const uint64_t due = begin + static_cast<uint64_t>(i * interval);
+			uint64_t now = monotonic();
+			if (due >= deadline || now >= deadline) {
+				break;
+			}
+			//落后时连续执行,超前时让出
+			while (now < due) {
+				if (due - now > 2000) {
+					Sleep(1);
+				}
+				else {
+					SwitchToThread();
+				}
+				now = monotonic();
+			}
+			if (m_workload == TREE_WORKLOAD || (m_workload == ALL_WORKLOAD && (i & 1))) {
+				tree();
+			}
+			else {
+				mixed();
+			}
+			++m_operations;
+		}
+		//未完成的文件周期补齐删除,避免残留文件影响下一级
+		if (!m_current.empty()) {
+			if (DeleteFileA(m_current.c_str())) {
+				expect(FileGuard::Action::REMOVED, m_current);
+			}
+			m_current.clear();
+		}
+	}
+
+	//预期事件
+	const std::vector<Expected>& expected() const
+	{
+		return m_expected;
+	}
+
+	//操作次数
+	uint64_t operations() const
+	{
+		return m_operations;
+	}
+
+	//失败次数
+	uint64_t failures() const
+	{
+		return m_failures;
+	}
+
+private:
+	void expect(uint32_t action, const std::string& file)
+	{
+		m_expected.push_back({ action, file, monotonic() });
+	}
+
+	/*
+	* @brief 文件周期(每次调用推进一步:创建->写入->重命名->删除)
+	* @return void
+	*/
+	void mixed()
+	{
+		switch (m_step++ & 3) {
+			case 0: {
+				m_current = m_dir + "\\f" + std::to_string(m_serial++) + ".dat";
+				HANDLE file = CreateFileA(m_current.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (file == INVALID_HANDLE_VALUE) {
+					++m_failures;
+					m_current.clear();
+					m_step = 0;
+					return;
+				}
+				CloseHandle(file);
+				expect(FileGuard::Action::ADDED, m_current);
+				break;
+			}
+			case 1: {
+				HANDLE file = CreateFileA(m_current.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (file == INVALID_HANDLE_VALUE) {
+					++m_failures;
+					break;
+				}
+				char buffer[256] = { 0 };
+				DWORD written = 0;
+				BOOL ok = WriteFile(file, buffer, sizeof(buffer), &written, nullptr);
+				CloseHandle(file);
+				if (!ok) {
+					++m_failures;
+					break;
+				}
+				expect(FileGuard::Action::MODIFIED, m_current);
+				break;
+			}
+			case 2: {
+				std::string renamed = m_current + ".renamed";
+				if (!MoveFileA(m_current.c_str(), renamed.c_str())) {
+					++m_failures;
+					break;
+				}
+				expect(FileGuard::Action::RENAMED_OLD_NAME, m_current);
+				expect(FileGuard::Action::RENAMED_NEW_NAME, renamed);
+				m_current = renamed;
+				break;
+			}
+			default: {
+				if (!DeleteFileA(m_current.c_str())) {
+					++m_failures;
+				}
+				else {
+					expect(FileGuard::Action::REMOVED, m_current);
+				}
+				m_current.clear();
+				break;
+			}
+		}
+	}
+
+	/*
+	* @brief 目录树周期(逐级创建depth层目录与叶子文件,再自底向上删除)
+	* @return void
+	*/
+	void tree()
+	{
+		std::vector<std::string> dirs;
+		std::string path = m_dir + "\\t" + std::to_string(m_serial++);
+		for (uint32_t i = 0; i < m_depth; ++i) {
+			if (!CreateDirectoryA(path.c_str(), nullptr)) {
+				++m_failures;
+				break;
+			}
+			expect(FileGuard::Action::ADDED, path);
+			dirs.push_back(path);
+			path += "\\d" + std::to_string(i);
+		}
+		if (dirs.size() == m_depth) {
+			std::string leaf = dirs.back() + "\\leaf.dat";
+			HANDLE file = CreateFileA(leaf.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				expect(FileGuard::Action::ADDED, leaf);
+				if (DeleteFileA(leaf.c_str())) {
+					expect(FileGuard::Action::REMOVED, leaf);
+				}
+				else {
+					++m_failures;
+				}
+			}
+			else {
+				++m_failures;
+			}
+		}
+		for (auto it = dirs.rbegin(); it != dirs.rend(); ++it) {
+			if (!RemoveDirectoryA(it->c_str())) {
+				++m_failures;
+				break;
+			}
+			expect(FileGuard::Action::REMOVED, *it);
+		}
+	}
+
+	std::string m_dir;
+	uint32_t m_depth;
+	int m_workload;
+	std::vector<Expected> m_expected;
+	std::string m_current;
+	uint64_t m_serial = 0;
+	uint32_t m_step = 0;
+	uint64_t m_operations = 0;
+	uint64_t m_failures = 0;
+};
+
+//核对结果
+struct Result
+{
+	//预期事件个数
+	uint64_t expected = 0;
+
+	//观察到的事件个数(不含预期之外的事件)
+	uint64_t observed = 0;
+
+	//丢失个数
+	uint64_t lost = 0;
+
+	//重复个数(名称类动作超出预期的次数,修改动作可能被内核拆分为多次,不计入)
+	uint64_t duplicated = 0;
+
+	//预期之外的事件个数(如父目录修改时间变化)
+	uint64_t unexpected = 0;
+
+	//序号逆序个数
+	uint64_t reordered = 0;
+
+	//操作完成到回调的延迟(微秒,已排序)
+	std::vector<uint64_t> latencies;
+};
+
+//核对计数
+struct Tally
+{
+	uint32_t count = 0;
+	uint32_t seen = 0;
+	uint64_t time = 0;
+};
+
+/*
+* @brief 核对预期与观察到的事件
+* @param[in] expected 预期事件
+* @param[in] observed 观察到的事件(按回调顺序)
+* @return 核对结果
+*/
+static Result reconcile(const std::vector<Expected>& expected, const std::vector<Observed>& observed)
+{
+	Result result;
+	std::unordered_map<std::string, Tally> tallies;
+	tallies.reserve(expected.size());
+	for (const auto& x : expected) {
+		Tally& tally = tallies[keyOf(x.action, x.file)];
+		if (!tally.count++) {
+			tally.time = x.time;
+		}
+		++result.expected;
+	}
+	uint64_t sequence = 0;
+	for (const auto& x : observed) {
+		if (x.sequence < sequence) {
+			++result.reordered;
+		}
+		sequence = (std::max)(sequence, x.sequence);
+		auto it = tallies.find(keyOf(x.action, x.file));
+		if (it == tallies.end()) {
+			++result.unexpected;
+			continue;
+		}
+		Tally& tally = it->second;
+		if (tally.seen < tally.count) {
+			++result.observed;
+			result.latencies.push_back(x.time > tally.time ? x.time - tally.time : 0);
+		}
+		else if (x.action != FileGuard::Action::MODIFIED) {
+			++result.duplicated;
+		}
+		++tally.seen;
+	}
+	for (const auto& x : tallies) {
+		if (x.second.seen < x.second.count) {
+			result.lost += x.second.count - x.second.seen;
+		}
+	}
+	std::sort(result.latencies.begin(), result.latencies.end());
+	return result;
+}
+
+//取已排序样本的百分位
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[(std::min)(index, sorted.size() - 1)];
+}
+
+static void usage()
+{
+	printf("用法: FileGuardStress <目录> [-t 线程数] [-s 每级秒数] [-r 速率1,速率2,...] [-d 目录深度]\n"
+		"                      [-m mixed|tree|all] [-q 排空毫秒数] [-M] [-i] [-p]\n");
+}
+
+static bool parse(int argc, char* argv[], Config& config)
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		return false;
+	}
+	char full[MAX_PATH] = { 0 };
+	if (!GetFullPathNameA(argv[1], MAX_PATH, full, nullptr)) {
+		return false;
+	}
+	config.root = full;
+	while (!config.root.empty() && (config.root.back() == '\\' || config.root.back() == '/')) {
+		config.root.pop_back();
+	}
+	for (int i = 2; i < argc; ++i) {
+		std::string flag = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (flag == "-M") {
+			config.metadata = true;
+		}
+		else if (flag == "-i") {
+			config.intern = true;
+		}
+		else if (flag == "-p") {
+			config.priority = true;
+		}
+		else if (!value) {
+			return false;
+		}
+		else {
+			++i;
+			if (flag == "-t") {
+				config.threads = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-s") {
+				config.seconds = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-d") {
+				config.depth = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-q") {
+				config.quiet = (std::max)(100, atoi(value));
+			}
+			else if (flag == "-r") {
+				config.rates.clear();
+				for (const char* p = value; *p;) {
+					int rate = atoi(p);
+					if (rate > 0) {
+						config.rates.push_back(rate);
+					}
+					p = strchr(p, ',');
+					if (!p) {
+						break;
+					}
+					++p;
+				}
+				if (config.rates.empty()) {
+					return false;
+				}
+			}
+			else if (flag == "-m") {
+				std::string mode = value;
+				if (mode == "mixed") {
+					config.workload = MIXED_WORKLOAD;
+				}
+				else if (mode == "tree") {
+					config.workload = TREE_WORKLOAD;
+				}
+				else if (mode == "all") {
+					config.workload = ALL_WORKLOAD;
+				}
+				else {
+					return false;
+				}
+			}
+			else {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	Config config;
+	if (!parse(argc, argv, config)) {
+		usage();
+		return 1;
+	}
+	CreateDirectoryA(config.root.c_str(), nullptr);
+	DWORD attributes = GetFileAttributesA(config.root.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		printf("目录[%s]不可用\n", config.root.c_str());
+		return 1;
+	}
+
+	Observer observer;
+	FileGuard guard;
+	guard.setMetadata(config.metadata);
+	guard.setIntern(config.intern);
+	guard.onChangedEx = [&guard, &observer](const FileGuard::Event& event) {
+		Observed x = { event.action, guard.getPath(event), monotonic(), event.sequence };
+		observer.last.store(x.time, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(observer.mutex);
+		observer.events.push_back(std::move(x));
+	};
+	guard.onError = [&observer](uint32_t error, const char* path) {
+		++observer.errors;
+		printf("onError-> 错误代码:%lu,路径:%s\n", error, path);
+	};
+	FileGuard::Option option;
+	if (config.priority) {
+		option.priority = 1;
+	}
+	if (!guard.addPath(config.root, option)) {
+		printf("添加路径[%s]失败\n", config.root.c_str());
+		return 1;
+	}
+	guard.start();
+
+	printf("目录:%s 线程:%zu 每级:%u秒 深度:%u 元数据:%d 驻留:%d 优先级:%d\n", config.root.c_str(), config.threads,
+		config.seconds, config.depth, config.metadata, config.intern, config.priority);
+	printf("%8s %9s %9s %9s %8s %8s %8s %8s %6s %10s %10s %10s %10s\n", "速率", "操作", "预期", "观察", "丢失%",
+		"重复%", "乱序", "溢出", "错误", "P50(us)", "P99(us)", "P999(us)", "内部P99");
+
+	for (size_t level = 0; level < config.rates.size(); ++level) {
+		//准备本级目录,等待其创建事件交付后清空观察记录
+		std::string dir = config.root + "\\level" + std::to_string(level);
+		removeTree(dir);
+		CreateDirectoryA(dir.c_str(), nullptr);
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (size_t i = 0; i < config.threads; ++i) {
+			std::string sub = dir + "\\w" + std::to_string(i);
+			CreateDirectoryA(sub.c_str(), nullptr);
+			workers.emplace_back(new Worker(sub, config.depth, config.workload));
+		}
+		Sleep(config.quiet);
+		{
+			std::lock_guard<std::mutex> lock(observer.mutex);
+			observer.events.clear();
+		}
+		observer.errors = 0;
+		guard.resetStatistics();
+
+		//按速率并发执行
+		const double rate = static_cast<double>(config.rates[level]) / config.threads;
+		const uint64_t deadline = monotonic() + static_cast<uint64_t>(config.seconds) * 1000000;
+		std::vector<std::thread> threads;
+		for (auto& worker : workers) {
+			Worker* w = worker.get();
+			threads.emplace_back([w, rate, deadline]() { w->run(rate, deadline); });
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		//排空:连续quiet毫秒没有新事件(最多等待30秒)
+		const uint64_t finished = monotonic();
+		observer.last = finished;
+		while (monotonic() - observer.last.load(std::memory_order_relaxed) < config.quiet * 1000ULL &&
+			monotonic() - finished < 30000000ULL) {
+			Sleep(50);
+		}
+
+		//核对
+		std::vector<Expected> expected;
+		uint64_t operations = 0;
+		uint64_t failures = 0;
+		for (auto& worker : workers) {
+			expected.insert(expected.end(), worker->expected().begin(), worker->expected().end());
+			operations += worker->operations();
+			failures += worker->failures();
+		}
+		std::vector<Observed> observed;
+		{
+			std::lock_guard<std::mutex> lock(observer.mutex);
+			observed.swap(observer.events);
+		}
+		FileGuard::Statistics statistics = guard.getStatistics();
+		Result result = reconcile(expected, observed);
+		const double total = result.expected ? static_cast<double>(result.expected) : 1.0;
+		printf("%8u %9llu %9llu %9llu %8.3f %8.3f %8llu %8llu %6llu %10llu %10llu %10llu %10llu\n",
+			config.rates[level], operations, result.expected, result.observed,
+			100.0 * result.lost / total, 100.0 * result.duplicated / total, result.reordered,
+			statistics.overflows, observer.errors.load(), percentile(result.latencies, 50),
+			percentile(result.latencies, 99), percentile(result.latencies, 99.9),
+			FileGuard::getPercentile(statistics, 99));
+		if (failures) {
+			printf("         本级%llu次文件操作失败(未计入预期)\n", failures);
+		}
+		if (result.unexpected) {
+			printf("         本级%llu个预期之外的事件(如父目录修改时间变化)\n", result.unexpected);
+		}
+
+		removeTree(dir);
+		Sleep(config.quiet);
+	}
+
+	guard.stop();
+	return 0;
+}
@@ -0,0 +1,171 @@
+﻿/*
+* FileGuard路径索引基准
+* 在指定目录下创建N个监控路径(每1000个一组,组目录本身不监控),依次计时:
+* 添加、existPath、findPath(路径下的文件)、getNestedPaths(按组)、getPaths与removePath,
+* 输出每次操作的平均耗时,用于确认各操作随路径个数增长保持常数或对数级.
+* 添加与删除包含打开、关闭目录句柄的耗时,另以同样个数的CreateFile/CloseHandle作为基线.
+*
+* 编译: cl /EHsc /O2 /std:c++17 /utf-8 stress\IndexBench.cpp FileGuard.cpp
+* 用法: IndexBench <目录> [-n 个数1,个数2,...](默认1000,10000,100000,目录保留以便重复运行)
+*/
+#include "../FileGuard.h"
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+//单调时钟(微秒)
+static uint64_t monotonic()
+{
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER li = { 0 };
+		QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	LARGE_INTEGER li = { 0 };
+	QueryPerformanceCounter(&li);
+	return static_cast<uint64_t>(li.QuadPart / frequency * 1000000 + li.QuadPart % frequency * 1000000 / frequency);
+}
+
+//第i个监控路径的组目录
+static std::string groupOf(const std::string& root, size_t i)
+{
+	char name[32] = { 0 };
+	sprintf_s(name, "g%05zu\\", i / 1000);
+	return root + name;
+}
+
+//第i个监控路径(以'\\'结尾)
+static std::string pathOf(const std::string& root, size_t i)
+{
+	char name[32] = { 0 };
+	sprintf_s(name, "p%07zu\\", i);
+	return groupOf(root, i) + name;
+}
+
+//输出一个阶段的耗时
+static void report(const char* phase, uint64_t elapsed, size_t count)
+{
+	printf("  %-16s %10.3f ms %10.3f us/次\n", phase, elapsed / 1000.0, count ? static_cast<double>(elapsed) / count : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		printf("用法: IndexBench <目录> [-n 个数1,个数2,...]\n");
+		return 1;
+	}
+
+	std::string root = argv[1];
+	if (root.back() != '\\' && root.back() != '/') {
+		root.append("\\");
+	}
+	std::vector<size_t> counts = { 1000, 10000, 100000 };
+	if (argc > 3 && !strcmp(argv[2], "-n")) {
+		counts.clear();
+		for (const char* p = argv[3]; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : nullptr) {
+			const size_t count = strtoull(p, nullptr, 10);
+			if (count) {
+				counts.push_back(count);
+			}
+		}
+	}
+
+	//按最大个数一次性创建目录
+	const size_t total = *std::max_element(counts.begin(), counts.end());
+	CreateDirectoryA(root.c_str(), nullptr);
+	const uint64_t prepare = monotonic();
+	for (size_t i = 0; i < total; ++i) {
+		if (i % 1000 == 0) {
+			CreateDirectoryA(groupOf(root, i).c_str(), nullptr);
+		}
+		const std::string path = pathOf(root, i);
+		if (!CreateDirectoryA(path.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+			printf("创建目录[%s]失败,错误代码:%lu\n", path.c_str(), GetLastError());
+			return 1;
+		}
+	}
+	printf("准备%zu个目录,耗时%.3f ms\n", total, (monotonic() - prepare) / 1000.0);
+
+	std::mt19937 random(12345);
+	for (size_t count : counts) {
+		std::vector<std::string> paths;
+		std::vector<std::string> files;
+		paths.reserve(count);
+		files.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			paths.push_back(pathOf(root, i));
+			files.push_back(paths.back() + "sub\\file.txt");
+		}
+		std::vector<size_t> order(count);
+		for (size_t i = 0; i < count; ++i) {
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), random);
+		printf("%zu个监控路径:\n", count);
+
+		//基线:打开并关闭同样的目录句柄
+		uint64_t tick = monotonic();
+		for (const auto& x : paths) {
+			HANDLE handle = CreateFileA(x.c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+			if (handle != INVALID_HANDLE_VALUE) {
+				CloseHandle(handle);
+			}
+		}
+		report("句柄基线", monotonic() - tick, count);
+
+		FileGuard guard;
+		tick = monotonic();
+		for (const auto& x : paths) {
+			if (!guard.addPath(x, true)) {
+				printf("添加路径[%s]失败:%s\n", x.c_str(), guard.getLastError());
+				return 1;
+			}
+		}
+		report("addPath", monotonic() - tick, count);
+
+		size_t found = 0;
+		tick = monotonic();
+		for (size_t i : order) {
+			found += guard.existPath(paths[i]);
+		}
+		report("existPath", monotonic() - tick, count);
+
+		tick = monotonic();
+		for (size_t i : order) {
+			found += guard.findPath(files[i]).size() == paths[i].size();
+		}
+		report("findPath", monotonic() - tick, count);
+
+		const size_t groups = (count + 999) / 1000;
+		size_t nested = 0;
+		tick = monotonic();
+		for (size_t i = 0; i < groups; ++i) {
+			nested += guard.getNestedPaths(groupOf(root, i * 1000)).size();
+		}
+		report("getNestedPaths", monotonic() - tick, groups);
+
+		tick = monotonic();
+		for (int i = 0; i < 10; ++i) {
+			nested += guard.getPaths().size();
+		}
+		report("getPaths", monotonic() - tick, 10);
+
+		tick = monotonic();
+		for (size_t i : order) {
+			guard.removePath(paths[i]);
+		}
+		report("removePath", monotonic() - tick, count);
+
+		if (found != count * 2 || nested != count * 11 || !guard.getPaths().empty()) {
+			printf("  校验失败:命中%zu(应为%zu),嵌套%zu(应为%zu)\n", found, count * 2, nested, count * 11);
+			return 1;
+		}
+	}
+	return 0;
+}
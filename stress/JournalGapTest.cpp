@@ -0,0 +1,147 @@
+﻿/*
+* FileJournal序号空缺测试
+* 写入若干段后删除中间的一段,模拟创建新段失败时丢弃已分配序号的记录,
+* 检查读取者能越过空缺读到最后一条记录,且在超时内返回而不是反复映射空缺之前的段.
+*
+* 编译: cl /EHsc /O2 /std:c++17 /utf-8 stress\JournalGapTest.cpp FileJournal.cpp FileGuard.cpp
+* 用法: JournalGapTest [目录](默认在临时目录下创建),成功时返回0
+*/
+#include "../FileJournal.h"
+#include <Windows.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+//写入的记录个数
+static const uint64_t RECORDS = 2000;
+
+//清空目录中的段与游标文件
+static void clean(const std::string& dir)
+{
+	const char* patterns[] = { "*.journal", "*.cursor" };
+	for (const char* pattern : patterns) {
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((dir + pattern).c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE) {
+			continue;
+		}
+		do {
+			DeleteFileA((dir + data.cFileName).c_str());
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+}
+
+//列出段文件的首个序号(升序)
+static std::vector<uint64_t> segments(const std::string& dir)
+{
+	std::vector<uint64_t> firsts;
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "*.journal").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			firsts.push_back(strtoull(data.cFileName, nullptr, 10));
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+	std::sort(firsts.begin(), firsts.end());
+	return firsts;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string dir;
+	if (argc > 1) {
+		dir = argv[1];
+	}
+	else {
+		char temp[MAX_PATH] = { 0 };
+		GetTempPathA(MAX_PATH, temp);
+		dir = std::string(temp) + "FileJournalGap";
+	}
+	if (dir.back() != '\\' && dir.back() != '/') {
+		dir.append("\\");
+	}
+	CreateDirectoryA(dir.c_str(), nullptr);
+	clean(dir);
+
+	//最小的段,每段约容纳280条记录
+	FileJournal journal;
+	FileJournal::Option option;
+	option.segment = 64 + 64 * 1024;
+	if (!journal.open(dir, option)) {
+		printf("打开日志失败:%s\n", journal.getLastError());
+		return 1;
+	}
+	const std::string path = "C:\\" + std::string(200, 'x') + "\\file.dat";
+	for (uint64_t i = 0; i < RECORDS; ++i) {
+		journal.append(FileGuard::Action::ADDED, path.c_str());
+	}
+	for (int i = 0; i < 500 && journal.getCommitted() < RECORDS; ++i) {
+		Sleep(10);
+	}
+	const uint64_t committed = journal.getCommitted();
+	journal.close();
+	if (committed != RECORDS) {
+		printf("只提交了%llu条记录\n", committed);
+		return 1;
+	}
+
+	//删除第二段,在第一段与第三段之间留下空缺
+	std::vector<uint64_t> firsts = segments(dir);
+	if (firsts.size() < 3) {
+		printf("段个数%zu不足3个\n", firsts.size());
+		return 1;
+	}
+	char name[64] = { 0 };
+	sprintf_s(name, "%020llu.journal", static_cast<unsigned long long>(firsts[1]));
+	if (!DeleteFileA((dir + name).c_str())) {
+		printf("删除段%s失败\n", name);
+		return 1;
+	}
+	const uint64_t gapBegin = firsts[1];
+	const uint64_t gapEnd = firsts[2];
+
+	//读取在独立线程中进行,修复前读取者会在空缺前反复切换而不返回
+	std::atomic<bool> done{ false };
+	bool ordered = true, skipped = true;
+	uint64_t last = 0, count = 0;
+	std::thread reader([&]() {
+		FileJournal::Reader reader;
+		if (reader.open(dir, "gap")) {
+			std::vector<FileJournal::Record> records(256);
+			std::vector<char> buffer(256 * 1024);
+			while (size_t n = reader.read(records.data(), records.size(), buffer.data(), buffer.size(), 100)) {
+				for (size_t i = 0; i < n; ++i) {
+					const uint64_t sequence = records[i].sequence;
+					ordered = ordered && sequence > last;
+					skipped = skipped && (sequence < gapBegin || sequence >= gapEnd);
+					last = sequence;
+					++count;
+				}
+			}
+		}
+		done = true;
+	});
+	for (int i = 0; i < 1000 && !done; ++i) {
+		Sleep(10);
+	}
+	if (!done) {
+		printf("失败:读取者在序号%llu之后的空缺处未返回\n", last);
+		ExitProcess(1);
+	}
+	reader.join();
+	clean(dir);
+
+	const uint64_t expected = RECORDS - (gapEnd - gapBegin);
+	if (!ordered || !skipped || last != RECORDS || count != expected) {
+		printf("失败:读取%llu条(应为%llu条),最后序号%llu(应为%llu),有序:%d,越过空缺:%d\n",
+			count, expected, last, RECORDS, ordered, skipped);
+		return 1;
+	}
+	printf("通过:读取%llu条,越过空缺[%llu, %llu)\n", count, gapBegin, gapEnd);
+	return 0;
+}
@@ -0,0 +1,301 @@
+﻿/*
+* FileGuard事件循环基准
+* 比较完成端口事件循环(FileGuard)与每个路径一个阻塞线程(同步ReadDirectoryChangesW)两种模型:
+* 由子进程在若干监控路径下不限速地创建并删除文件,每次迭代产生ADDED与REMOVED两个事件,
+* 本进程只运行监控,因此进程CPU时间即为监控的开销.排空后输出交付速率、丢失率、溢出次数与每个事件的CPU时间.
+*
+* 编译: cl /EHsc /O2 /std:c++17 /utf-8 stress\LoopBench.cpp FileGuard.cpp
+* 用法: LoopBench <目录> [-p 路径个数] [-t 写入线程数] [-s 秒数] [-m iocp|thread|both]
+*   -p 监控路径个数(默认64)  -t 子进程的写入线程数(默认4)  -s 写入持续秒数(默认10)  -m 模型(默认both)
+*/
+#include "../FileGuard.h"
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+//单调时钟(微秒)
+static uint64_t monotonic()
+{
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER li = { 0 };
+		QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	LARGE_INTEGER li = { 0 };
+	QueryPerformanceCounter(&li);
+	return static_cast<uint64_t>(li.QuadPart / frequency * 1000000 + li.QuadPart % frequency * 1000000 / frequency);
+}
+
+//本进程的CPU时间(微秒,用户态与内核态之和)
+static uint64_t cpuTime()
+{
+	FILETIME create, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user)) {
+		return 0;
+	}
+	auto value = [](const FILETIME& x) {
+		return (static_cast<uint64_t>(x.dwHighDateTime) << 32) | x.dwLowDateTime;
+	};
+	return (value(kernel) + value(user)) / 10;
+}
+
+//第i个监控路径(以'\\'结尾)
+static std::string rootOf(const std::string& dir, size_t i)
+{
+	return dir + "r" + std::to_string(i) + "\\";
+}
+
+/*
+* @brief 写入(子进程):各线程轮流在监控路径下创建并删除文件
+* @return 迭代次数(每次两个事件)
+*/
+static DWORD generate(const std::string& dir, size_t roots, size_t threads, uint32_t seconds)
+{
+	std::atomic<DWORD> iterations{ 0 };
+	const uint64_t deadline = monotonic() + seconds * 1000000ull;
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			DWORD count = 0;
+			for (size_t i = t; monotonic() < deadline; i += threads) {
+				const std::string file = rootOf(dir, i % roots) + "f" + std::to_string(t) + ".tmp";
+				HANDLE handle = CreateFileA(file.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (handle == INVALID_HANDLE_VALUE) {
+					continue;
+				}
+				CloseHandle(handle);
+				if (DeleteFileA(file.c_str())) {
+					++count;
+				}
+			}
+			iterations += count;
+		});
+	}
+	for (auto& x : workers) {
+		x.join();
+	}
+	return iterations;
+}
+
+//每个路径一个线程的参照模型(FileGuard改用完成端口之前的方式)
+class ThreadModel
+{
+public:
+	ThreadModel(std::atomic<uint64_t>& delivered, std::atomic<uint64_t>& overflows) :
+		m_delivered(delivered), m_overflows(overflows)
+	{
+	}
+
+	~ThreadModel()
+	{
+		stop();
+	}
+
+	bool start(const std::vector<std::string>& roots)
+	{
+		for (const auto& x : roots) {
+			HANDLE handle = CreateFileA(x.c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			m_handles.push_back(handle);
+		}
+
+		for (size_t i = 0; i < m_handles.size(); ++i) {
+			m_threads.emplace_back(&ThreadModel::run, this, m_handles[i], roots[i]);
+		}
+		return true;
+	}
+
+	void stop()
+	{
+		m_quit = true;
+		for (auto& x : m_threads) {
+			//阻塞的同步读取只能由取消唤醒,线程可能尚未进入读取,重复取消直到退出
+			while (WaitForSingleObject(x.native_handle(), 10) == WAIT_TIMEOUT) {
+				CancelSynchronousIo(x.native_handle());
+			}
+			x.join();
+		}
+		m_threads.clear();
+
+		for (auto x : m_handles) {
+			CloseHandle(x);
+		}
+		m_handles.clear();
+	}
+
+private:
+	void run(HANDLE handle, std::string root)
+	{
+		std::vector<char> buffer(64 * 1024);
+		std::string file;
+		char name[MAX_PATH * 3] = { 0 };
+		while (!m_quit) {
+			DWORD bytes = 0;
+			if (!ReadDirectoryChangesW(handle, buffer.data(), static_cast<DWORD>(buffer.size()), TRUE,
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+				&bytes, nullptr, nullptr)) {
+				break;
+			}
+
+			if (!bytes) {
+				++m_overflows;
+				continue;
+			}
+
+			//与FileGuard的解码相同:转换为ANSI并拼接完整路径
+			uint64_t count = 0;
+			for (DWORD offset = 0;;) {
+				const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer.data() + offset);
+				const int length = WideCharToMultiByte(CP_ACP, 0, info->FileName,
+					static_cast<int>(info->FileNameLength / sizeof(WCHAR)), name, sizeof(name) - 1, nullptr, nullptr);
+				file.assign(root).append(name, length > 0 ? length : 0);
+				++count;
+				if (!info->NextEntryOffset) {
+					break;
+				}
+				offset += info->NextEntryOffset;
+			}
+			m_delivered += count;
+		}
+	}
+
+	std::atomic<uint64_t>& m_delivered;
+	std::atomic<uint64_t>& m_overflows;
+	std::atomic<bool> m_quit{ false };
+	std::vector<HANDLE> m_handles;
+	std::vector<std::thread> m_threads;
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		printf("用法: LoopBench <目录> [-p 路径个数] [-t 写入线程数] [-s 秒数] [-m iocp|thread|both]\n");
+		return 1;
+	}
+
+	std::string dir = argv[1];
+	if (dir.back() != '\\' && dir.back() != '/') {
+		dir.append("\\");
+	}
+	size_t roots = 64, threads = 4;
+	uint32_t seconds = 10;
+	std::string mode = "both";
+	bool child = false;
+	for (int i = 2; i < argc; ++i) {
+		const std::string flag = argv[i];
+		if (flag == "-g") {
+			child = true;
+		}
+		else if (i + 1 < argc) {
+			const char* value = argv[++i];
+			if (flag == "-p") {
+				roots = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-t") {
+				threads = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-s") {
+				seconds = (std::max)(1, atoi(value));
+			}
+			else if (flag == "-m") {
+				mode = value;
+			}
+		}
+	}
+
+	if (child) {
+		return static_cast<int>(generate(dir, roots, threads, seconds));
+	}
+
+	CreateDirectoryA(dir.c_str(), nullptr);
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < roots; ++i) {
+		paths.push_back(rootOf(dir, i));
+		CreateDirectoryA(paths.back().c_str(), nullptr);
+	}
+
+	char self[MAX_PATH] = { 0 };
+	GetModuleFileNameA(nullptr, self, MAX_PATH);
+	printf("路径:%zu 写入线程:%zu 写入:%u秒\n", roots, threads, seconds);
+	printf("%-8s %12s %12s %12s %8s %8s %10s %12s\n", "模型", "产生/秒", "交付", "交付/秒", "丢失%", "溢出",
+		"CPU(ms)", "CPU(us)/事件");
+
+	for (const char* model : { "iocp", "thread" }) {
+		if (mode != "both" && mode != model) {
+			continue;
+		}
+
+		std::atomic<uint64_t> delivered{ 0 }, overflows{ 0 };
+		FileGuard guard;
+		ThreadModel reference(delivered, overflows);
+		if (!strcmp(model, "iocp")) {
+			for (const auto& x : paths) {
+				guard.addPath(x, true);
+			}
+			guard.onChanged = [&delivered](uint32_t, const char*) {
+				delivered.fetch_add(1, std::memory_order_relaxed);
+			};
+			guard.onError = [&overflows](uint32_t error, const char*) {
+				if (error == ERROR_NOTIFY_ENUM_DIR) {
+					++overflows;
+				}
+			};
+			guard.start();
+		}
+		else if (!reference.start(paths)) {
+			printf("打开监控路径失败\n");
+			return 1;
+		}
+		Sleep(200);
+
+		//写入在子进程中进行,本进程的CPU时间只含监控
+		const uint64_t cpu = cpuTime();
+		const uint64_t begin = monotonic();
+		//目录末尾的'\\'会转义引号,传给子进程时去掉
+		std::string command = "\"" + std::string(self) + "\" \"" + dir.substr(0, dir.size() - 1) + "\" -g -p " + std::to_string(roots) +
+			" -t " + std::to_string(threads) + " -s " + std::to_string(seconds);
+		STARTUPINFOA startup = { sizeof(startup) };
+		PROCESS_INFORMATION process = { 0 };
+		if (!CreateProcessA(nullptr, &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) {
+			printf("启动写入进程失败,错误代码:%lu\n", GetLastError());
+			return 1;
+		}
+		WaitForSingleObject(process.hProcess, INFINITE);
+		DWORD iterations = 0;
+		GetExitCodeProcess(process.hProcess, &iterations);
+		CloseHandle(process.hThread);
+		CloseHandle(process.hProcess);
+		const uint64_t written = monotonic();
+
+		//排空:连续500毫秒没有新事件,交付速率不计最后的等待
+		for (uint64_t last = ~0ull; last != delivered.load();) {
+			last = delivered.load();
+			Sleep(500);
+		}
+		const uint64_t elapsed = monotonic() - 500000 - begin;
+		const uint64_t used = cpuTime() - cpu;
+		const uint64_t events = iterations * 2ull;
+		const uint64_t count = delivered.load();
+
+		if (!strcmp(model, "iocp")) {
+			guard.stop();
+		}
+		else {
+			reference.stop();
+		}
+
+		printf("%-8s %12.0f %12llu %12.0f %8.3f %8llu %10.1f %12.3f\n", model,
+			events * 1000000.0 / (written - begin), count, count * 1000000.0 / elapsed,
+			events ? 100.0 * (events > count ? events - count : 0) / events : 0.0, overflows.load(),
+			used / 1000.0, count ? static_cast<double>(used) / count : 0.0);
+	}
+	return 0;
+}
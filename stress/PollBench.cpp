@@ -0,0 +1,198 @@
+﻿/*
+* FileGuard轮询基准
+* 在指定目录下准备大量文件(每1000个一个子目录,目录保留以便重复运行),以固定间隔的轮询方式监控,
+* 每轮扫描之前修改若干文件,按扫描完成次数(Statistics::reads)划分轮次,输出每轮的耗时、
+* 进程CPU时间与I/O操作次数(GetProcessIoCounters),以及每个条目的平均开销.
+* 修改文件在轮次之间进行,其I/O不计入下一轮.
+*
+* 编译: cl /EHsc /O2 /std:c++17 /utf-8 stress\PollBench.cpp FileGuard.cpp
+* 用法: PollBench <目录> [-n 文件个数] [-c 每轮修改个数] [-i 间隔毫秒] [-r 轮数]
+*   -n 文件个数(默认1000000)  -c 每轮修改的文件个数(默认100)  -i 轮询间隔(默认5000)  -r 计时的轮数(默认10)
+*/
+#include "../FileGuard.h"
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+
+//单调时钟(微秒)
+static uint64_t monotonic()
+{
+	static const LONGLONG frequency = []() {
+		LARGE_INTEGER li = { 0 };
+		QueryPerformanceFrequency(&li);
+		return li.QuadPart;
+	}();
+	LARGE_INTEGER li = { 0 };
+	QueryPerformanceCounter(&li);
+	return static_cast<uint64_t>(li.QuadPart / frequency * 1000000 + li.QuadPart % frequency * 1000000 / frequency);
+}
+
+//进程开销的采样
+struct Sample
+{
+	uint64_t tick; //单调时钟(微秒)
+	uint64_t cpu; //CPU时间(微秒,用户态与内核态之和)
+	uint64_t operations; //I/O操作次数(读取、写入与其他操作之和,目录列举计入其他操作)
+};
+
+static Sample sample()
+{
+	Sample result = { monotonic(), 0, 0 };
+	FILETIME create, exit, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user)) {
+		auto value = [](const FILETIME& x) {
+			return (static_cast<uint64_t>(x.dwHighDateTime) << 32) | x.dwLowDateTime;
+		};
+		result.cpu = (value(kernel) + value(user)) / 10;
+	}
+	IO_COUNTERS io = { 0 };
+	if (GetProcessIoCounters(GetCurrentProcess(), &io)) {
+		result.operations = io.ReadOperationCount + io.WriteOperationCount + io.OtherOperationCount;
+	}
+	return result;
+}
+
+//第i个文件
+static std::string fileOf(const std::string& root, size_t i)
+{
+	char name[32] = { 0 };
+	sprintf_s(name, "d%05zu\\f%03zu.dat", i / 1000, i % 1000);
+	return root + name;
+}
+
+//等待扫描完成次数超过count,超时返回false
+static bool waitScan(const FileGuard& guard, uint64_t count, uint64_t timeout)
+{
+	const uint64_t deadline = monotonic() + timeout * 1000;
+	while (guard.getStatistics().reads <= count) {
+		if (monotonic() >= deadline) {
+			return false;
+		}
+		Sleep(1);
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		printf("用法: PollBench <目录> [-n 文件个数] [-c 每轮修改个数] [-i 间隔毫秒] [-r 轮数]\n");
+		return 1;
+	}
+
+	std::string root = argv[1];
+	if (root.back() != '\\' && root.back() != '/') {
+		root.append("\\");
+	}
+	size_t files = 1000000, changes = 100, rounds = 10;
+	uint32_t interval = 5000;
+	for (int i = 2; i + 1 < argc; i += 2) {
+		const std::string flag = argv[i];
+		const size_t value = strtoull(argv[i + 1], nullptr, 10);
+		if (flag == "-n") {
+			files = (std::max<size_t>)(1, value);
+		}
+		else if (flag == "-c") {
+			changes = value;
+		}
+		else if (flag == "-i") {
+			interval = static_cast<uint32_t>((std::max<size_t>)(100, value));
+		}
+		else if (flag == "-r") {
+			rounds = (std::max<size_t>)(1, value);
+		}
+	}
+
+	//按子目录准备文件,子目录的最后一个文件已存在时跳过,中断后重新运行可继续
+	CreateDirectoryA(root.c_str(), nullptr);
+	const uint64_t prepare = monotonic();
+	for (size_t begin = 0; begin < files; begin += 1000) {
+		const size_t end = (std::min)(begin + 1000, files);
+		if (GetFileAttributesA(fileOf(root, end - 1).c_str()) != INVALID_FILE_ATTRIBUTES) {
+			continue;
+		}
+		const std::string dir = fileOf(root, begin);
+		CreateDirectoryA(dir.substr(0, dir.rfind('\\')).c_str(), nullptr);
+		for (size_t i = begin; i < end; ++i) {
+			HANDLE handle = CreateFileA(fileOf(root, i).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) {
+				printf("创建文件[%s]失败,错误代码:%lu\n", fileOf(root, i).c_str(), GetLastError());
+				return 1;
+			}
+			CloseHandle(handle);
+		}
+	}
+	const uint64_t entries = files + (files + 999) / 1000;
+	printf("准备%zu个文件,耗时%.3f s\n", files, (monotonic() - prepare) / 1000000.0);
+
+	std::atomic<uint64_t> events{ 0 };
+	FileGuard guard;
+	FileGuard::Option option;
+	option.backend = FileGuard::POLLING_BACKEND;
+	option.interval = interval;
+	if (!guard.addPath(root, option)) {
+		printf("添加路径失败:%s\n", guard.getLastError());
+		return 1;
+	}
+	guard.onChanged = [&events](uint32_t, const char*) {
+		events.fetch_add(1, std::memory_order_relaxed);
+	};
+
+	//首次扫描建立快照,不产生事件
+	Sample last = sample();
+	guard.start();
+	if (!waitScan(guard, 0, 3600 * 1000)) {
+		printf("首次扫描超时\n");
+		return 1;
+	}
+	Sample now = sample();
+	printf("首次扫描: %.3f ms, CPU %.3f ms, I/O %llu次\n", (now.tick - last.tick) / 1000.0, (now.cpu - last.cpu) / 1000.0,
+		now.operations - last.operations);
+	printf("%4s %10s %10s %10s %12s %10s %12s %8s\n", "轮次", "扫描(ms)", "周期(ms)", "CPU(ms)", "CPU(ns)/条目",
+		"I/O次数", "I/O/千条目", "事件");
+
+	std::mt19937 random(12345);
+	double totalCpu = 0, totalOperations = 0, totalScan = 0;
+	for (size_t round = 1; round <= rounds; ++round) {
+		//在两轮之间修改文件(追加一个字节,使大小与修改时间变化),之后再开始计量
+		for (size_t i = 0; i < changes; ++i) {
+			HANDLE handle = CreateFileA(fileOf(root, random() % files).c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle != INVALID_HANDLE_VALUE) {
+				DWORD written = 0;
+				WriteFile(handle, "x", 1, &written, nullptr);
+				CloseHandle(handle);
+			}
+		}
+		const uint64_t delivered = events.load();
+		last = sample();
+		const uint64_t previous = now.tick;
+
+		if (!waitScan(guard, round, 3600 * 1000)) {
+			printf("第%zu轮扫描超时\n", round);
+			return 1;
+		}
+		now = sample();
+
+		//周期为两次扫描完成的间隔,扫描耗时为周期减去固定间隔(受计时器精度影响)
+		const uint64_t cycle = now.tick - previous;
+		const double scan = cycle > interval * 1000ull ? (cycle - interval * 1000ull) / 1000.0 : 0.0;
+		const uint64_t cpu = now.cpu - last.cpu;
+		const uint64_t operations = now.operations - last.operations;
+		totalScan += scan;
+		totalCpu += cpu;
+		totalOperations += operations;
+		printf("%4zu %10.1f %10.1f %10.1f %12.1f %10llu %12.2f %8llu\n", round, scan, cycle / 1000.0, cpu / 1000.0,
+			cpu * 1000.0 / entries, operations, operations * 1000.0 / entries, events.load() - delivered);
+	}
+	guard.stop();
+
+	printf("平均: 扫描%.1f ms, CPU %.1f ms(%.1f ns/条目), I/O %.0f次(%.2f次/千条目), 条目%llu\n", totalScan / rounds,
+		totalCpu / rounds / 1000.0, totalCpu * 1000.0 / rounds / entries, totalOperations / rounds,
+		totalOperations * 1000.0 / rounds / entries, entries);
+	return 0;
+}